@@ -0,0 +1,98 @@
+/*
+ * arena.c : Bump allocator for menu data
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? \
+      sizeof(void *) : sizeof(double))
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct _arena_chunk {
+  arena_chunk_t *next;
+  size_t size;
+  size_t used;
+  /* Keep the data aligned for any type we store */
+  double data[];
+};
+
+void
+arena_init (arena_t *arena, size_t chunk_size)
+{
+  arena->chunks = NULL;
+  arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+}
+
+void
+arena_clear (arena_t *arena)
+{
+  arena_chunk_t *chunk, *next;
+
+  for (chunk = arena->chunks; chunk; chunk = next) {
+    next = chunk->next;
+    free (chunk);
+  }
+  arena->chunks = NULL;
+}
+
+void *
+arena_alloc (arena_t *arena, size_t size)
+{
+  arena_chunk_t *chunk = arena->chunks;
+  void *ptr;
+
+  size = ARENA_ROUND (size);
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    size_t chunk_size = arena->chunk_size;
+
+    /* Oversized allocations get a chunk of their own */
+    if (chunk_size < size)
+      chunk_size = size;
+    chunk = malloc (sizeof(arena_chunk_t) + chunk_size);
+    if (chunk == NULL)
+      return NULL;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    if (arena->chunk_size < ARENA_MAX_CHUNK_SIZE)
+      arena->chunk_size *= 2;
+  }
+
+  ptr = (char *) chunk->data + chunk->used;
+  chunk->used += size;
+
+  return ptr;
+}
+
+char *
+arena_strdup (arena_t *arena, const char *str)
+{
+  size_t len = strlen (str) + 1;
+  char *copy = arena_alloc (arena, len);
+
+  if (copy)
+    memcpy (copy, str, len);
+
+  return copy;
+}
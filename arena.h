@@ -0,0 +1,51 @@
+/*
+ * arena.h : Bump allocator for menu data
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+typedef struct _arena_chunk arena_chunk_t;
+
+/**
+ * arena_t:
+ * @chunks: The chunks allocated so far, most recent first
+ * @chunk_size: The size of the next chunk to allocate
+ *
+ * Hands out memory from large chunks, so that many small allocations
+ * cost one malloc per chunk and can all be released at once.
+ * Chunk sizes double up to %ARENA_MAX_CHUNK_SIZE.
+ */
+typedef struct {
+  arena_chunk_t *chunks;
+  size_t chunk_size;
+} arena_t;
+
+void arena_init (arena_t *arena, size_t chunk_size);
+/* Frees every chunk, the arena can be used again afterwards */
+void arena_clear (arena_t *arena);
+void *arena_alloc (arena_t *arena, size_t size);
+char *arena_strdup (arena_t *arena, const char *str);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,103 @@
+/*
+ * bitset.c : Compact set of item indices
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "bitset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BITS_PER_WORD ((int) (sizeof(unsigned long) * 8))
+#define NWORDS(n) (((n) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+
+int
+bitset_init (bitset_t *set, int nbits)
+{
+  memset (set, 0, sizeof(bitset_t));
+
+  return bitset_resize (set, nbits);
+}
+
+void
+bitset_clear (bitset_t *set)
+{
+  free (set->words);
+  memset (set, 0, sizeof(bitset_t));
+}
+
+int
+bitset_resize (bitset_t *set, int nbits)
+{
+  int old_words = NWORDS(set->nbits);
+  int new_words = NWORDS(nbits);
+  unsigned long *words;
+
+  if (new_words > old_words) {
+    words = realloc (set->words, new_words * sizeof(unsigned long));
+    if (words == NULL)
+      return -1;
+    memset (words + old_words, 0,
+        (new_words - old_words) * sizeof(unsigned long));
+    set->words = words;
+  }
+  /* Indices dropped by an earlier shrink may still be set */
+  if (nbits > set->nbits && set->nbits % BITS_PER_WORD)
+    set->words[old_words - 1] &= (1UL << (set->nbits % BITS_PER_WORD)) - 1;
+  set->nbits = nbits;
+
+  return 0;
+}
+
+void
+bitset_set (bitset_t *set, int index, int value)
+{
+  unsigned long mask = 1UL << (index % BITS_PER_WORD);
+
+  if (value)
+    set->words[index / BITS_PER_WORD] |= mask;
+  else
+    set->words[index / BITS_PER_WORD] &= ~mask;
+}
+
+int
+bitset_get (bitset_t *set, int index)
+{
+  return (set->words[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
+}
+
+int
+bitset_next (bitset_t *set, int index)
+{
+  int word = index / BITS_PER_WORD;
+  unsigned long bits;
+
+  if (index < 0 || index >= set->nbits)
+    return -1;
+
+  /* Skip whole words of cleared indices at once */
+  bits = set->words[word] & (~0UL << (index % BITS_PER_WORD));
+  while (bits == 0) {
+    if (++word >= NWORDS(set->nbits))
+      return -1;
+    bits = set->words[word];
+  }
+  index = (word * BITS_PER_WORD) + __builtin_ctzl (bits);
+
+  return index < set->nbits ? index : -1;
+}
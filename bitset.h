@@ -0,0 +1,44 @@
+/*
+ * bitset.h : Compact set of item indices
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __BITSET_H__
+#define __BITSET_H__
+
+/**
+ * bitset_t:
+ * @words: One bit per index
+ * @nbits: How many indices @words has room for
+ */
+typedef struct {
+  unsigned long *words;
+  int nbits;
+} bitset_t;
+
+/* Returns -1 on error. Indices start cleared */
+int bitset_init (bitset_t *set, int nbits);
+void bitset_clear (bitset_t *set);
+/* Make room for @nbits indices, the new ones are cleared */
+int bitset_resize (bitset_t *set, int nbits);
+void bitset_set (bitset_t *set, int index, int value);
+int bitset_get (bitset_t *set, int index);
+/* The first index at or after @index that is set, or -1 */
+int bitset_next (bitset_t *set, int index);
+
+#endif /* __BITSET_H__ */
@@ -343,6 +343,21 @@ int cairo_dri_flip_buffer(cairo_surface_t *surface, int vsync)
   if (fb == NULL)
     return -1;
 
+  if (vsync && !fb->dri->page_flip_failed) {
+    struct drm_mode_crtc_page_flip flip = {0};
+
+    flip.crtc_id = fb->screen->crtc;
+    flip.fb_id = fb->fb_id;
+    flip.flags = DRM_MODE_PAGE_FLIP_EVENT;
+    flip.user_data = (uint64_t) fb->screen;
+    if (ioctl(fb->dri->dri_fd, DRM_IOCTL_MODE_PAGE_FLIP, &flip) == 0)
+      return 1;
+    /* Not every driver supports page flipping, fallback to setting the CRTC
+     * from now on */
+    PERROR ("Can't schedule page flip");
+    fb->dri->page_flip_failed = 1;
+  }
+
   crtc = fb->screen->saved_crtc;
   crtc.crtc_id = fb->screen->crtc;
   crtc.fb_id = fb->fb_id;
@@ -358,3 +373,28 @@ int cairo_dri_flip_buffer(cairo_surface_t *surface, int vsync)
 
   return 0;
 }
+
+int cairo_dri_handle_events(cairo_dri_t *dri)
+{
+  char buffer[1024];
+  int flips = 0;
+  int len, i;
+
+  len = read(dri->dri_fd, buffer, sizeof(buffer));
+  if (len < 0) {
+    PERROR ("Can't read DRM events");
+    return -1;
+  }
+
+  for (i = 0; i + sizeof(struct drm_event) <= len;) {
+    struct drm_event *event = (struct drm_event *) &buffer[i];
+
+    if (event->length < sizeof(struct drm_event))
+      break;
+    if (event->type == DRM_EVENT_FLIP_COMPLETE)
+      flips++;
+    i += event->length;
+  }
+
+  return flips;
+}
@@ -36,16 +36,26 @@ typedef struct {
 typedef struct {
   int dri_fd;
   int master_is_set;
+  /* The driver can't schedule flips, the CRTC gets set instead */
+  int page_flip_failed;
 
   dri_screen_t *screens;
   int num_screens;
 } cairo_dri_t ;
 
 /*
- * Flip framebuffer, return the next buffer id which will be used or -1 if
- * an operation failed
+ * Flip framebuffer. If vsync is set, the flip is scheduled for the next
+ * vblank and 1 is returned, a flip complete event will then be readable on
+ * dri_fd and must be consumed with cairo_dri_handle_events() before the
+ * previous buffer can be drawn to again. Returns 0 if the flip was done
+ * immediately or -1 if an operation failed
  */
 int cairo_dri_flip_buffer(cairo_surface_t *surface, int vsync);
+/*
+ * Read the pending events from dri_fd, return the number of completed
+ * flips or -1 if an operation failed
+ */
+int cairo_dri_handle_events(cairo_dri_t *dri);
 /* Create a cairo surface using the specified framebuffer
  * can return an error if fb driver doesn't support double buffering
  */
@@ -20,9 +20,11 @@
  */
 
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <time.h>
 
 #include "cairo_menu.h"
 #include "cairo_utils.h"
@@ -348,6 +350,7 @@ cairo_menu_new_full (cairo_surface_t *surface, int rows, int columns,
   menu = malloc (sizeof(CairoMenu));
 
   memset (menu, 0, sizeof(CairoMenu));
+  arena_init (&menu->arena, 0);
   menu->surface = cairo_surface_reference (surface);
   menu->rows = rows;
   menu->columns = columns;
@@ -360,6 +363,7 @@ cairo_menu_new_full (cairo_surface_t *surface, int rows, int columns,
   menu->items = NULL;
   menu->selection = 0; /* Select the first item by default */
   menu->start_item = 0;
+  menu->dirty = TRUE;
 
   if (bg_image)
     menu->bg_image = cairo_surface_reference (bg_image);
@@ -434,8 +438,26 @@ cairo_menu_add_item_full (CairoMenu *menu, cairo_surface_t *image,
       menu->nitems >= (menu->rows * menu->columns))
     return -1;
 
+  /* Virtual menus don't store their items */
+  if (menu->provider)
+    return -1;
+
+  /* Grow geometrically so adding many items doesn't keep copying them */
+  if (menu->nitems == menu->allocated_items) {
+    int allocated = menu->allocated_items ? menu->allocated_items * 2 : 16;
+    CairoMenuItem *items;
+
+    items = realloc (menu->items, allocated * sizeof(CairoMenuItem));
+    if (items == NULL)
+      return -1;
+    menu->items = items;
+    menu->allocated_items = allocated;
+  }
   menu->nitems++;
-  menu->items = realloc (menu->items, menu->nitems * sizeof(CairoMenuItem));
+  menu->skip_valid = FALSE;
+  menu->layout_valid = FALSE;
+  if (width != menu->default_item_width || height != menu->default_item_height)
+    menu->nonuniform_items = TRUE;
 
   item = &menu->items[menu->nitems - 1];
   memset (item, 0, sizeof(CairoMenuItem));
@@ -443,7 +465,8 @@ cairo_menu_add_item_full (CairoMenu *menu, cairo_surface_t *image,
   item->index = menu->nitems - 1;
   item->image = NULL;
   item->image_position = image_position;
-  item->text = text ? strdup (text) : NULL;
+  item->text = text ? arena_strdup (&menu->arena, text) : NULL;
+  item->text_allocated = text ? strlen (text) + 1 : 0;
   item->text_size = text_size;
   item->text_color = text_color;
   item->alignment = alignment;
@@ -470,6 +493,8 @@ cairo_menu_add_item_full (CairoMenu *menu, cairo_surface_t *image,
   if (image != NULL)
     cairo_menu_set_item_image (menu, item->index, image, image_position);
 
+  menu->dirty = TRUE;
+
   return item->index;
 }
 
@@ -483,12 +508,117 @@ cairo_menu_add_item (CairoMenu *menu, const char *text, int text_size)
       NULL, NULL, NULL, NULL);
 }
 
+void
+cairo_menu_set_item_provider (CairoMenu *menu, int nitems, int text_size,
+    CairoMenuItemProviderCb provider, void *user_data)
+{
+  menu->provider = provider;
+  menu->provider_data = user_data;
+  menu->provider_text_size = text_size;
+  menu->nitems = nitems;
+  menu->skip_valid = FALSE;
+  menu->layout_valid = FALSE;
+  menu->selection = 0;
+  menu->start_item = 0;
+  menu->dirty = TRUE;
+}
+
+CairoMenuItem *
+cairo_menu_get_item (CairoMenu *menu, int item_index)
+{
+  CairoMenuItem *item = &menu->virtual_item;
+
+  if (menu->provider == NULL)
+    return &menu->items[item_index];
+
+  /* Same defaults as cairo_menu_add_item() */
+  memset (item, 0, sizeof(CairoMenuItem));
+  item->index = item_index;
+  item->image_position = CAIRO_MENU_IMAGE_POSITION_LEFT;
+  item->text_size = menu->provider_text_size;
+  item->text_color = CAIRO_MENU_DEFAULT_TEXT_COLOR;
+  item->alignment = CAIRO_MENU_ALIGN_MIDDLE_CENTER;
+  item->draw_cb = _draw_item;
+  item->width = menu->default_item_width;
+  item->height = menu->default_item_height;
+  item->ipad_x = CAIRO_MENU_DEFAULT_IPAD_X;
+  item->ipad_y = CAIRO_MENU_DEFAULT_IPAD_Y;
+  item->enabled = TRUE;
+  item->bg_image = menu->bg_image;
+  item->bg_sel_image = menu->bg_sel_image;
+
+  menu->provider (menu, item, menu->provider_data);
+
+  return item;
+}
+
+void
+cairo_menu_set_item_text (CairoMenu *menu, int item_index, const char *text)
+{
+  CairoMenuItem *item;
+  size_t size;
+
+  if (menu->provider)
+    return;
+
+  item = &menu->items[item_index];
+  if (text == NULL) {
+    item->text = NULL;
+    return;
+  }
+
+  /* The old text can't be freed on its own, so keep reusing the biggest one
+   * to avoid growing the arena on every update */
+  size = strlen (text) + 1;
+  if (item->text && size <= item->text_allocated) {
+    strcpy (item->text, text);
+  } else {
+    item->text = arena_strdup (&menu->arena, text);
+    item->text_allocated = item->text ? size : 0;
+  }
+}
+
+void
+cairo_menu_set_item_enabled (CairoMenu *menu, int item_index, int enabled)
+{
+  if (menu->provider)
+    return;
+
+  menu->items[item_index].enabled = enabled;
+  menu->skip_valid = FALSE;
+}
+
+void
+cairo_menu_set_item_size (CairoMenu *menu, int item_index,
+    int width, int height)
+{
+  CairoMenuItem *item;
+
+  if (menu->provider)
+    return;
+
+  item = &menu->items[item_index];
+  if (item->width == width && item->height == height)
+    return;
+
+  item->width = width;
+  item->height = height;
+  if (width != menu->default_item_width || height != menu->default_item_height)
+    menu->nonuniform_items = TRUE;
+  menu->layout_valid = FALSE;
+  menu->dirty = TRUE;
+}
+
 void
 cairo_menu_set_item_image (CairoMenu *menu, int item_index, cairo_surface_t *image,
     CairoMenuImagePosition image_position)
 {
-  CairoMenuItem *item = &menu->items[item_index];
+  CairoMenuItem *item;
 
+  if (menu->provider)
+    return;
+
+  item = &menu->items[item_index];
   if (item->image)
     cairo_surface_destroy (item->image);
 
@@ -502,35 +632,395 @@ cairo_menu_set_item_image (CairoMenu *menu, int item_index, cairo_surface_t *ima
     else
       item->image = _load_image (image, item->height - (2 * item->ipad_y));
   }
+  menu->dirty = TRUE;
+}
+
+
+struct _CairoMenuCachedItem {
+  int index;
+  cairo_surface_t *surface;
+};
+
+/* The items are laid out on a grid. Each row is as tall as its tallest item
+ * and each column as wide as its widest one. The offsets of the rows and
+ * columns are kept as prefix sums, so finding an item's position or the item
+ * at a position doesn't need to walk the items. Menus where all the items
+ * have the default size don't need the tables at all. */
+
+static void
+_get_grid_size (CairoMenu *menu, int *nrows, int *ncolumns)
+{
+  if (menu->columns != -1) {
+    *ncolumns = menu->columns;
+    *nrows = (menu->nitems + menu->columns - 1) / menu->columns;
+  } else {
+    *nrows = menu->rows;
+    *ncolumns = (menu->nitems + menu->rows - 1) / menu->rows;
+  }
 }
 
+static void
+_get_item_cell (CairoMenu *menu, int item_index, int *row, int *column)
+{
+  if (menu->columns != -1) {
+    *row = item_index / menu->columns;
+    *column = item_index % menu->columns;
+  } else {
+    *row = item_index % menu->rows;
+    *column = item_index / menu->rows;
+  }
+}
 
+/* The item in a cell, or -1 past the last item */
 static int
-_handle_input_internal (CairoMenu *menu, CairoMenuInput input,
-    CairoMenuRectangle *bbox)
+_get_cell_item (CairoMenu *menu, int row, int column)
+{
+  int item_index;
+
+  if (menu->columns != -1)
+    item_index = (row * menu->columns) + column;
+  else
+    item_index = (column * menu->rows) + row;
+
+  return item_index < menu->nitems ? item_index : -1;
+}
+
+static int
+_build_layout (CairoMenu *menu)
+{
+  int nrows, ncolumns;
+  int *row_offsets, *column_offsets;
+  int i, row, column;
+
+  menu->layout_valid = TRUE;
+  free (menu->row_offsets);
+  free (menu->column_offsets);
+  menu->row_offsets = menu->column_offsets = NULL;
+
+  /* Virtual items are expected to keep the default size */
+  if (!menu->nonuniform_items || menu->provider)
+    return 0;
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  row_offsets = calloc (nrows + 1, sizeof(int));
+  column_offsets = calloc (ncolumns + 1, sizeof(int));
+  if (row_offsets == NULL || column_offsets == NULL) {
+    free (row_offsets);
+    free (column_offsets);
+    menu->layout_valid = FALSE;
+    return -1;
+  }
+
+  /* Find the size of each row and column first, at offset + 1 */
+  for (i = 0; i < menu->nitems; i++) {
+    CairoMenuItem *item = &menu->items[i];
+
+    _get_item_cell (menu, i, &row, &column);
+    if (item->height + (2 * menu->pad_y) > row_offsets[row + 1])
+      row_offsets[row + 1] = item->height + (2 * menu->pad_y);
+    if (item->width + (2 * menu->pad_x) > column_offsets[column + 1])
+      column_offsets[column + 1] = item->width + (2 * menu->pad_x);
+  }
+  for (row = 0; row < nrows; row++)
+    row_offsets[row + 1] += row_offsets[row];
+  for (column = 0; column < ncolumns; column++)
+    column_offsets[column + 1] += column_offsets[column];
+
+  menu->row_offsets = row_offsets;
+  menu->column_offsets = column_offsets;
+
+  return 0;
+}
+
+/* Distance from the first row to the top of @row */
+static int
+_get_row_offset (CairoMenu *menu, int row)
+{
+  if (!menu->layout_valid)
+    _build_layout (menu);
+  if (menu->row_offsets)
+    return menu->row_offsets[row];
+  return row * (menu->default_item_height + (2 * menu->pad_y));
+}
+
+static int
+_get_column_offset (CairoMenu *menu, int column)
+{
+  if (!menu->layout_valid)
+    _build_layout (menu);
+  if (menu->column_offsets)
+    return menu->column_offsets[column];
+  return column * (menu->default_item_width + (2 * menu->pad_x));
+}
+
+/* The last of the @n + 1 @offsets that is <= @pos */
+static int
+_search_offsets (int *offsets, int n, int pos)
+{
+  int start = 0, end = n + 1;
+
+  while (end - start > 1) {
+    int mid = start + (end - start) / 2;
+
+    if (offsets[mid] <= pos)
+      start = mid;
+    else
+      end = mid;
+  }
+
+  return start;
+}
+
+/* The row or column that contains @pos, which may be past the last one */
+static int
+_get_row_at (CairoMenu *menu, int pos)
+{
+  int nrows, ncolumns;
+
+  if (!menu->layout_valid)
+    _build_layout (menu);
+  if (pos < 0)
+    return -1;
+  if (menu->row_offsets == NULL)
+    return pos / (menu->default_item_height + (2 * menu->pad_y));
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  return _search_offsets (menu->row_offsets, nrows, pos);
+}
+
+static int
+_get_column_at (CairoMenu *menu, int pos)
+{
+  int nrows, ncolumns;
+
+  if (!menu->layout_valid)
+    _build_layout (menu);
+  if (pos < 0)
+    return -1;
+  if (menu->column_offsets == NULL)
+    return pos / (menu->default_item_width + (2 * menu->pad_x));
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  return _search_offsets (menu->column_offsets, ncolumns, pos);
+}
+
+static void
+_get_start_cell (CairoMenu *menu, int *start_row, int *start_column)
+{
+  _get_item_cell (menu, menu->start_item, start_row, start_column);
+}
+
+/* Whether any part of an item's cell is on the surface */
+static int
+_is_item_visible (CairoMenu *menu, int item_index)
+{
+  int row, start_row, column, start_column;
+  int width, height;
+
+  _get_item_cell (menu, item_index, &row, &column);
+  _get_start_cell (menu, &start_row, &start_column);
+  if (row < start_row || column < start_column)
+    return FALSE;
+
+  cairo_utils_get_surface_size (menu->surface, &width, &height);
+  return _get_row_offset (menu, row) - _get_row_offset (menu, start_row) <
+      height && _get_column_offset (menu, column) -
+      _get_column_offset (menu, start_column) < width;
+}
+
+/* How many rows and columns are entirely visible from the current scroll
+ * position, at least one of each */
+static void
+_get_max_visible (CairoMenu *menu, int *max_visible_rows,
+    int *max_visible_columns)
 {
-  int row, new_row, start_row, max_rows, max_visible_rows;
-  int column, new_column, start_column, max_columns, max_visible_columns;
   int width, height;
+  int start_row, start_column;
 
   cairo_utils_get_surface_size (menu->surface, &width, &height);
+  _get_start_cell (menu, &start_row, &start_column);
+
+  *max_visible_rows = _get_row_at (menu,
+      _get_row_offset (menu, start_row) + height) - start_row;
+  *max_visible_columns = _get_column_at (menu,
+      _get_column_offset (menu, start_column) + width) - start_column;
+
+  if (*max_visible_rows <= 0)
+    *max_visible_rows = 1;
+  if (*max_visible_columns <= 0)
+    *max_visible_columns = 1;
+}
+
+/* How many items fit on the surface */
+static int
+_get_page_size (CairoMenu *menu)
+{
+  int max_visible_rows, max_visible_columns;
+
+  _get_max_visible (menu, &max_visible_rows, &max_visible_columns);
+  if (menu->columns != -1)
+    return max_visible_rows * menu->columns;
+  else
+    return max_visible_columns * menu->rows;
+}
+
+/* Scroll the least amount needed for the selection to be visible */
+static void
+_scroll_to_selection (CairoMenu *menu)
+{
+  int row, start_row, end;
+  int column, start_column;
+  int width, height;
+
+  cairo_utils_get_surface_size (menu->surface, &width, &height);
+  _get_item_cell (menu, menu->selection, &row, &column);
+  _get_start_cell (menu, &start_row, &start_column);
+
+  /* When going forward, the first row to show is the first one that lets
+   * the bottom of the selection fit */
+  if (row < start_row) {
+    start_row = row;
+  } else {
+    end = _get_row_offset (menu, row + 1);
+    if (end - _get_row_offset (menu, start_row) > height) {
+      start_row = _get_row_at (menu, end - height - 1) + 1;
+      if (start_row > row)
+        start_row = row;
+    }
+  }
+  if (column < start_column) {
+    start_column = column;
+  } else {
+    end = _get_column_offset (menu, column + 1);
+    if (end - _get_column_offset (menu, start_column) > width) {
+      start_column = _get_column_at (menu, end - width - 1) + 1;
+      if (start_column > column)
+        start_column = column;
+    }
+  }
+
+  if (menu->columns != -1)
+    menu->start_item = (start_row * menu->columns) + start_column;
+  else
+    menu->start_item = (start_column * menu->rows) + start_row;
+}
+
+/* Anything else that makes the menu dirty needs a full redraw */
+static void
+_mark_moved (CairoMenu *menu)
+{
+  if (!menu->dirty)
+    menu->dirty = CAIRO_MENU_DIRTY_SELECTION;
+}
+
+/* Build the tables giving the closest enabled item in each direction, so
+ * runs of disabled items are skipped in one step */
+static int
+_build_skip_table (CairoMenu *menu)
+{
+  int *next, *prev;
+  int i, last;
+
+  /* Virtual menus would need to query every single item */
+  if (menu->provider)
+    return -1;
+
+  next = realloc (menu->next_enabled, menu->nitems * sizeof(int));
+  if (next == NULL)
+    return -1;
+  menu->next_enabled = next;
+  prev = realloc (menu->prev_enabled, menu->nitems * sizeof(int));
+  if (prev == NULL)
+    return -1;
+  menu->prev_enabled = prev;
+
+  for (i = 0, last = -1; i < menu->nitems; i++) {
+    if (menu->items[i].enabled)
+      last = i;
+    prev[i] = last;
+  }
+  for (i = menu->nitems - 1, last = -1; i >= 0; i--) {
+    if (menu->items[i].enabled)
+      last = i;
+    next[i] = last;
+  }
+  menu->skip_valid = TRUE;
+
+  return 0;
+}
+
+/* The closest enabled item from @id in direction @dir, or -1 */
+static int
+_find_enabled (CairoMenu *menu, int id, int dir)
+{
+  if (id < 0 || id >= menu->nitems)
+    return -1;
+
+  if (menu->skip_valid || _build_skip_table (menu) == 0)
+    return dir > 0 ? menu->next_enabled[id] : menu->prev_enabled[id];
+
+  while (id >= 0 && id < menu->nitems &&
+      cairo_menu_get_item (menu, id)->enabled == FALSE)
+    id += dir;
+
+  return (id >= 0 && id < menu->nitems) ? id : -1;
+}
+
+/* Page/Home/End go straight to their target instead of moving one cell at
+ * a time, then scroll once */
+static int
+_jump_selection (CairoMenu *menu, CairoMenuInput input)
+{
+  int page = _get_page_size (menu);
+  int target, enabled, dir;
 
-  /* TODO: Actually walk the items and calculate the real value depending on
-     individual item's width/height */
-  max_visible_rows = height / (menu->default_item_height + (2 * menu->pad_y));
-  max_visible_columns = width / (menu->default_item_width + (2 * menu->pad_x));
+  switch (input) {
+    case CAIRO_MENU_INPUT_PAGE_UP:
+      target = menu->selection - page;
+      dir = -1;
+      break;
+    case CAIRO_MENU_INPUT_PAGE_DOWN:
+      target = menu->selection + page;
+      dir = 1;
+      break;
+    case CAIRO_MENU_INPUT_HOME:
+      target = 0;
+      dir = 1;
+      break;
+    case CAIRO_MENU_INPUT_END:
+    default:
+      target = menu->nitems - 1;
+      dir = -1;
+      break;
+  }
+  if (target < 0)
+    target = 0;
+  if (target >= menu->nitems)
+    target = menu->nitems - 1;
+
+  /* Past the first or last enabled item, stop at it */
+  enabled = _find_enabled (menu, target, dir);
+  if (enabled < 0)
+    enabled = _find_enabled (menu, target, -dir);
+
+  if (enabled >= 0) {
+    menu->selection = enabled;
+    _scroll_to_selection (menu);
+  }
 
-  if (max_visible_rows == 0)
-    max_visible_rows = 1;
-  if (max_visible_columns == 0)
-    max_visible_columns = 1;
+  return menu->selection;
+}
+
+static int
+_handle_input_internal (CairoMenu *menu, CairoMenuInput input)
+{
+  int row, max_rows;
+  int column, max_columns;
 
   /* Define which row/column the selection is in */
   if (menu->columns != -1) {
     row = menu->selection / menu->columns;
     column = menu->selection % menu->columns;
-    start_row = menu->start_item / menu->columns;
-    start_column = menu->start_item % menu->columns;
 
     if (menu->nitems < menu->columns)
       max_columns = menu->nitems;
@@ -544,8 +1034,6 @@ _handle_input_internal (CairoMenu *menu, CairoMenuInput input,
   } else {
     column = menu->selection / menu->rows;
     row = menu->selection % menu->rows;
-    start_row = menu->start_item % menu->rows;
-    start_column = menu->start_item / menu->rows;
 
     if (menu->nitems < menu->rows)
       max_rows = menu->nitems;
@@ -599,212 +1087,645 @@ _handle_input_internal (CairoMenu *menu, CairoMenuInput input,
         }
       }
       break;
+    default:
+      /* Jumps are handled by _jump_selection() */
+      break;
   }
 
-  if (menu->columns != -1) {
-    new_row = menu->selection / menu->columns;
-    new_column = menu->selection % menu->columns;
-  } else {
-    new_column = menu->selection / menu->rows;
-    new_row = menu->selection % menu->rows;
-  }
-
-  /*
-  printf ("row - %d - new %d - start %d - max %d - visible %d\n",
-      row, new_row, start_row, max_rows, max_visible_rows);
-  printf ("column - %d - new %d - start %d - max %d - visible %d\n",
-      column, new_column, start_column, max_columns, max_visible_columns);
-  */
-
-  if (new_row < start_row || new_column < start_column) {
-    /* We go left/up back to a non-displayed item */
-    if (menu->columns != -1) {
-      if (input == CAIRO_MENU_INPUT_LEFT)
-        menu->start_item -= 1;
-      else
-        menu->start_item -= menu->columns;
-    } else {
-      if (input == CAIRO_MENU_INPUT_LEFT)
-        menu->start_item -= menu->rows;
-      else
-        menu->start_item -= 1;
-    }
-    cairo_menu_redraw (menu);
-
-    bbox->x = 0;
-    bbox->y = 0;
-    cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
-  } else if (((new_row - start_row) >= max_visible_rows) ||
-      ((new_column - start_column) >= max_visible_columns)) {
-    /* We go right/down to a hidden item */
-    if (menu->columns != -1) {
-      /* If we go on the right, we only need to shift by one column.
-         If we go down, we need to shift by own row */
-      if (input == CAIRO_MENU_INPUT_RIGHT)
-        menu->start_item += 1;
-      else
-        menu->start_item += menu->columns;
-    } else {
-      if (input == CAIRO_MENU_INPUT_RIGHT)
-        menu->start_item += menu->rows;
-      else
-        menu->start_item += 1;
-    }
-    cairo_menu_redraw (menu);
-
-    bbox->x = 0;
-    bbox->y = 0;
-    cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
-  } else {
-    /* TODO: Only redraw the part that we need, and set the right bbox */
-    cairo_menu_redraw (menu);
-
-    bbox->x = 0;
-    bbox->y = 0;
-    cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
-  }
+  /* Bring the new selection into view, which may take more than one row or
+   * column if they have different sizes */
+  _scroll_to_selection (menu);
 
   return menu->selection;
 }
 
 int
-cairo_menu_handle_input (CairoMenu *menu, CairoMenuInput input,
-    CairoMenuRectangle *bbox)
+cairo_menu_move_selection (CairoMenu *menu, CairoMenuInput input)
 {
   int old_start_item;
   int old_selection;
   int new_selection;
   int previous_selection;
 
-  if (menu->items == NULL)
+  if (menu->nitems == 0)
     return -1;
 
   old_start_item = menu->start_item;
   old_selection = new_selection = previous_selection = menu->selection;
 
-  do {
-    new_selection = _handle_input_internal (menu, input, bbox);
+  if (input >= CAIRO_MENU_INPUT_PAGE_UP) {
+    new_selection = _jump_selection (menu, input);
+    if (menu->selection != old_selection)
+      _mark_moved (menu);
+    return new_selection;
+  }
 
-    /* Make sure this isn't the last possible item we can go to */
-    if (new_selection == previous_selection)
-      break;
+  new_selection = _handle_input_internal (menu, input);
+
+  /* In a single row or column, the items in the direction we're going are
+   * in index order, so the skip table finds the next enabled one at once */
+  if (new_selection != old_selection &&
+      abs (new_selection - old_selection) == 1 &&
+      (menu->columns == 1 || menu->rows == 1) &&
+      cairo_menu_get_item (menu, new_selection)->enabled == FALSE) {
+    new_selection = _find_enabled (menu, new_selection,
+        new_selection - old_selection);
+    if (new_selection >= 0) {
+      menu->selection = new_selection;
+      _scroll_to_selection (menu);
+    } else {
+      menu->selection = new_selection = old_selection;
+      menu->start_item = old_start_item;
+    }
+  }
+
+  /* Otherwise step over them one at a time, this is only model work and
+   * nothing gets drawn until the selection settles */
+  while (new_selection != previous_selection &&
+      cairo_menu_get_item (menu, new_selection)->enabled == FALSE) {
     previous_selection = new_selection;
-  } while (menu->items[new_selection].enabled == FALSE);
+    new_selection = _handle_input_internal (menu, input);
+  }
 
   /* We were already on the last selectable item, then revert */
-  if (menu->items[new_selection].enabled == FALSE) {
+  if (cairo_menu_get_item (menu, new_selection)->enabled == FALSE) {
     menu->selection = new_selection = old_selection;
     menu->start_item = old_start_item;
+  }
 
-    cairo_menu_redraw (menu);
+  if (menu->selection != old_selection || menu->start_item != old_start_item)
+    _mark_moved (menu);
 
-    bbox->x = 0;
-    bbox->y = 0;
-    cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
-  }
+  return new_selection;
+}
+
+int
+cairo_menu_handle_input (CairoMenu *menu, CairoMenuInput input,
+    CairoMenuRectangle *bbox)
+{
+  int new_selection;
+
+  new_selection = cairo_menu_move_selection (menu, input);
+  if (new_selection == -1)
+    return -1;
+
+  /* TODO: Only redraw the part that we need, and set the right bbox */
+  cairo_menu_redraw (menu);
+
+  bbox->x = 0;
+  bbox->y = 0;
+  cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
 
   return new_selection;
 }
 
+int
+cairo_menu_select (CairoMenu *menu, int id)
+{
+  if (cairo_menu_get_item (menu, id)->enabled == FALSE)
+    return -1;
+
+  if (menu->selection != id) {
+    menu->selection = id;
+    _scroll_to_selection (menu);
+    _mark_moved (menu);
+  }
+
+  return id;
+}
+
 void
 cairo_menu_set_selection (CairoMenu *menu, int id, CairoMenuRectangle *bbox)
 {
-
-  if (menu->items[id].enabled == FALSE)
+  if (cairo_menu_select (menu, id) < 0)
     return;
 
-  menu->selection = id;
-  //TODO : menu->start_item = old_start_item;
-
   cairo_menu_redraw (menu);
   bbox->x = 0;
   bbox->y = 0;
   cairo_utils_get_surface_size (menu->surface, &bbox->width, &bbox->height);
 }
 
+/* The first row to show for the view to start at @y, rounded to the
+ * closest row and without scrolling past the last one */
+static int
+_get_start_row_for (CairoMenu *menu, int y)
+{
+  int nrows, ncolumns, height, total, row, max_row;
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  height = cairo_utils_get_surface_height (menu->surface);
+  total = _get_row_offset (menu, nrows);
+  if (nrows == 0 || total <= height || y <= 0)
+    return 0;
+
+  max_row = _get_row_at (menu, total - height - 1) + 1;
+  row = _get_row_at (menu, y);
+  if (row < nrows &&
+      y - _get_row_offset (menu, row) > (_get_row_offset (menu, row + 1) -
+          _get_row_offset (menu, row)) / 2)
+    row++;
+
+  return row < max_row ? row : max_row;
+}
+
+static int
+_get_start_column_for (CairoMenu *menu, int x)
+{
+  int nrows, ncolumns, width, total, column, max_column;
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  width = cairo_utils_get_surface_width (menu->surface);
+  total = _get_column_offset (menu, ncolumns);
+  if (ncolumns == 0 || total <= width || x <= 0)
+    return 0;
+
+  max_column = _get_column_at (menu, total - width - 1) + 1;
+  column = _get_column_at (menu, x);
+  if (column < ncolumns &&
+      x - _get_column_offset (menu, column) > (_get_column_offset (menu,
+              column + 1) - _get_column_offset (menu, column)) / 2)
+    column++;
+
+  return column < max_column ? column : max_column;
+}
+
 void
-cairo_menu_redraw (CairoMenu *menu)
+cairo_menu_get_scroll (CairoMenu *menu, int *x, int *y)
+{
+  int start_row, start_column;
+
+  _get_start_cell (menu, &start_row, &start_column);
+  *x = _get_column_offset (menu, start_column);
+  *y = _get_row_offset (menu, start_row);
+}
+
+int
+cairo_menu_scroll_to (CairoMenu *menu, int x, int y)
+{
+  int start_row, start_column, start_item;
+
+  start_row = _get_start_row_for (menu, y);
+  start_column = _get_start_column_for (menu, x);
+  if (menu->columns != -1)
+    start_item = (start_row * menu->columns) + start_column;
+  else
+    start_item = (start_column * menu->rows) + start_row;
+
+  if (start_item == menu->start_item || start_item >= menu->nitems)
+    return FALSE;
+
+  menu->start_item = start_item;
+  _mark_moved (menu);
+
+  return TRUE;
+}
+
+void
+cairo_menu_set_item_count (CairoMenu *menu, int nitems)
 {
+  int old_nitems = menu->nitems;
+
+  /* Regular menus only have room for the items that were added */
+  if (menu->provider == NULL)
+    return;
+
+  menu->nitems = nitems;
+  menu->skip_valid = FALSE;
+  menu->layout_valid = FALSE;
+
+  if (nitems < old_nitems) {
+    if (menu->selection >= nitems)
+      menu->selection = nitems > 0 ? nitems - 1 : 0;
+    if (menu->start_item >= nitems)
+      menu->start_item = 0;
+    menu->dirty = TRUE;
+  } else if (nitems > old_nitems &&
+      _is_item_visible (menu, old_nitems) && !menu->dirty) {
+    /* Only the new items need to be drawn */
+    menu->dirty = CAIRO_MENU_DIRTY_SELECTION;
+  }
+}
+
+int
+cairo_menu_get_item_at (CairoMenu *menu, int x, int y)
+{
+  CairoMenuRectangle rect;
+  int nrows, ncolumns;
+  int start_row, start_column;
+  int row, column, item_index;
+
+  if (x < 0 || y < 0 || menu->nitems == 0)
+    return -1;
+
+  _get_grid_size (menu, &nrows, &ncolumns);
+  _get_start_cell (menu, &start_row, &start_column);
+  row = _get_row_at (menu, _get_row_offset (menu, start_row) + y);
+  column = _get_column_at (menu, _get_column_offset (menu, start_column) + x);
+  if (row >= nrows || column >= ncolumns)
+    return -1;
+  item_index = _get_cell_item (menu, row, column);
+  if (item_index < 0)
+    return -1;
+
+  /* Ignore the padding and the empty space left by bigger items */
+  cairo_menu_get_item_rect (menu, item_index, &rect);
+  if (x < rect.x || x >= rect.x + rect.width ||
+      y < rect.y || y >= rect.y + rect.height)
+    return -1;
+
+  return item_index;
+}
+
+int
+cairo_menu_get_item_rect (CairoMenu *menu, int item_index,
+    CairoMenuRectangle *rect)
+{
+  CairoMenuItem *item;
+  int start_row, start_column;
+  int row, column;
+
+  if (item_index < 0 || item_index >= menu->nitems)
+    return FALSE;
+
+  item = cairo_menu_get_item (menu, item_index);
+  _get_start_cell (menu, &start_row, &start_column);
+  _get_item_cell (menu, item_index, &row, &column);
+  rect->x = _get_column_offset (menu, column) -
+      _get_column_offset (menu, start_column) + menu->pad_x;
+  rect->y = _get_row_offset (menu, row) -
+      _get_row_offset (menu, start_row) + menu->pad_y;
+  rect->width = item->width;
+  rect->height = item->height;
+
+  return TRUE;
+}
+
+static void
+_cache_invalidate (CairoMenu *menu, int item_index)
+{
+  CairoMenuCachedItem *cached;
+
+  if (menu->ncache == 0)
+    return;
+
+  cached = &menu->cache[item_index % menu->ncache];
+  if (cached->index == item_index && cached->surface) {
+    cairo_surface_destroy (cached->surface);
+    cached->surface = NULL;
+    cached->index = -1;
+  }
+}
+
+static void
+_cache_clear (CairoMenu *menu)
+{
+  int i;
+
+  for (i = 0; i < menu->ncache; i++) {
+    if (menu->cache[i].surface)
+      cairo_surface_destroy (menu->cache[i].surface);
+    menu->cache[i].surface = NULL;
+    menu->cache[i].index = -1;
+  }
+}
+
+/* Slots are direct mapped, so as long as there are more slots than the
+ * pages we prefetch, neighbouring items never evict each other */
+static int
+_cache_resize (CairoMenu *menu)
+{
+  int ncache = menu->cache_pages * _get_page_size (menu);
+  CairoMenuCachedItem *cache;
   int i;
+
+  if (ncache == menu->ncache)
+    return 0;
+
+  _cache_clear (menu);
+  menu->ncache = 0;
+  if (ncache == 0) {
+    free (menu->cache);
+    menu->cache = NULL;
+    return 0;
+  }
+
+  cache = realloc (menu->cache, ncache * sizeof(CairoMenuCachedItem));
+  if (cache == NULL)
+    return -1;
+  for (i = 0; i < ncache; i++) {
+    cache[i].index = -1;
+    cache[i].surface = NULL;
+  }
+  menu->cache = cache;
+  menu->ncache = ncache;
+
+  return 0;
+}
+
+static cairo_surface_t *
+_cache_lookup (CairoMenu *menu, int item_index)
+{
+  CairoMenuCachedItem *cached;
+
+  if (menu->ncache == 0)
+    return NULL;
+
+  cached = &menu->cache[item_index % menu->ncache];
+  return cached->index == item_index ? cached->surface : NULL;
+}
+
+/* Returns TRUE if something had to be rendered */
+static int
+_cache_render (CairoMenu *menu, int item_index)
+{
+  CairoMenuCachedItem *cached = &menu->cache[item_index % menu->ncache];
+  CairoMenuItem *item;
   cairo_t *cr;
-  int width, height;
-  int x = 0;
-  int y = 0;
-  int row, start_row;
-  int column, start_column;
 
-  cr = cairo_create (menu->surface);
+  if (cached->index == item_index)
+    return FALSE;
 
-  /* Clear the whole surface before redrawing */
-  cairo_save (cr);
-  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
-  cairo_paint (cr);
-  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-  cairo_restore (cr);
+  item = cairo_menu_get_item (menu, item_index);
+  if (item->draw_cb != _draw_item)
+    return FALSE;
 
-  cairo_utils_get_surface_size (menu->surface, &width, &height);
+  if (cached->surface)
+    cairo_surface_destroy (cached->surface);
+  cached->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+      item->width, item->height);
+  cached->index = item_index;
 
-  /* Define which row/column we're drawing if we're scrolled */
-  if (menu->columns != -1) {
-    row = menu->start_item / menu->columns;
-    column = menu->start_item % menu->columns;
+  cr = cairo_create (cached->surface);
+  item->draw_cb (menu, item, FALSE, cr, 0, 0, item->draw_data);
+  cairo_destroy (cr);
+  cairo_surface_flush (cached->surface);
+
+  return TRUE;
+}
+
+void
+cairo_menu_set_cache_pages (CairoMenu *menu, int pages)
+{
+  menu->cache_pages = pages;
+  _cache_resize (menu);
+}
+
+int
+cairo_menu_prefetch (CairoMenu *menu, int budget_us)
+{
+  struct timespec start, now;
+  int page, i, pass;
+
+  if (menu->cache_pages == 0 || menu->dirty || _cache_resize (menu) != 0)
+    return FALSE;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  page = _get_page_size (menu);
+
+  /* The next page first, since that's where we're usually going */
+  for (pass = 0; pass < 2; pass++) {
+    int first = pass == 0 ? menu->start_item + page : menu->start_item - page;
+
+    for (i = first; i < first + page; i++) {
+      if (i < 0 || i >= menu->nitems || !_cache_render (menu, i))
+        continue;
+
+      clock_gettime (CLOCK_MONOTONIC, &now);
+      if ((now.tv_sec - start.tv_sec) * 1000000 +
+          (now.tv_nsec - start.tv_nsec) / 1000 >= budget_us)
+        return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+_draw_item_at (CairoMenu *menu, cairo_t *cr, int item_index, int x, int y,
+    int clear)
+{
+  CairoMenuItem *item = cairo_menu_get_item (menu, item_index);
+  cairo_surface_t *cached;
+
+  if (clear) {
+    /* Drawing over the previous content of the item */
+    cairo_rectangle (cr, x, y, item->width, item->height);
+    cairo_clip (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+  }
+  if (menu->dropshadow) {
+    cairo_set_source_surface (cr, menu->dropshadow,
+        x - menu->dropshadow_radius, y - menu->dropshadow_radius);
+    cairo_paint (cr);
+  }
+  cairo_rectangle (cr, x, y, item->width, item->height);
+  cairo_clip (cr);
+  cached = _cache_lookup (menu, item_index);
+  if (cached && menu->selection != item_index) {
+    cairo_set_source_surface (cr, cached, x, y);
+    cairo_paint (cr);
   } else {
-    row = menu->start_item % menu->rows;
-    column = menu->start_item / menu->rows;
+    item->draw_cb (menu, item, (menu->selection == item->index), cr,
+        x, y, item->draw_data);
   }
-  start_row = row;
-  start_column = column;
+  cairo_reset_clip (cr);
+}
 
-  for (i = menu->start_item; i < menu->nitems;) {
-    CairoMenuItem *item = &menu->items[i];
+/* Draw the visible items, all of them or only the items from index @first
+ * to @last, over their previous content, if @first isn't -1.
+ * Only the rows and columns that intersect the surface are visited. */
+static void
+_draw_items (CairoMenu *menu, cairo_t *cr, int first, int last)
+{
+  int width, height;
+  int nrows, ncolumns;
+  int row, start_row, base_y, y;
+  int column, start_column, base_x, x;
+  int i;
 
-    x += menu->pad_x;
-    y += menu->pad_y;
+  cairo_utils_get_surface_size (menu->surface, &width, &height);
+  _get_grid_size (menu, &nrows, &ncolumns);
+  _get_start_cell (menu, &start_row, &start_column);
+  base_y = _get_row_offset (menu, start_row);
+  base_x = _get_column_offset (menu, start_column);
 
-    /* No need to draw the items that are outside the visible area */
-    if (x < width && y < height) {
-      if (menu->dropshadow) {
-        cairo_set_source_surface (cr, menu->dropshadow,
-            x - menu->dropshadow_radius, y - menu->dropshadow_radius);
-        cairo_paint (cr);
-      }
-      cairo_rectangle (cr, x, y, item->width, item->height);
-      cairo_clip (cr);
-      item->draw_cb (menu, item, (menu->selection == item->index), cr,
-          x, y, item->draw_data);
+  /* Scrolled out of view */
+  if (first != -1 && last < menu->start_item)
+    return;
+
+  /* A single item can be placed directly */
+  if (first != -1 && first == last) {
+    if (first >= menu->nitems)
+      return;
+    _get_item_cell (menu, first, &row, &column);
+    if (row < start_row || column < start_column)
+      return;
+    y = _get_row_offset (menu, row) - base_y;
+    x = _get_column_offset (menu, column) - base_x;
+    if (y < height && x < width)
+      _draw_item_at (menu, cr, first, x + menu->pad_x, y + menu->pad_y, TRUE);
+    return;
+  }
+
+  for (row = start_row; row < nrows; row++) {
+    y = _get_row_offset (menu, row) - base_y;
+    if (y >= height)
+      break;
+
+    for (column = start_column; column < ncolumns; column++) {
+      x = _get_column_offset (menu, column) - base_x;
+      if (x >= width)
+        break;
+
+      i = _get_cell_item (menu, row, column);
+      if (i < 0 || (first != -1 && (i < first || i > last)))
+        continue;
+      _draw_item_at (menu, cr, i, x + menu->pad_x, y + menu->pad_y,
+          first != -1);
     }
+  }
+}
+
+/* When only the selection moved and the menu scrolled by at most one row
+ * (or column), move the pixels that are still valid and only draw the row
+ * that got uncovered and the two items whose selection state changed */
+static int
+_redraw_moved (CairoMenu *menu, cairo_t *cr)
+{
+  int delta = menu->start_item - menu->drawn_start_item;
+  int width, height;
+  int line, pitch, size, start, end;
+  int first, last;
+
+  if (delta != 0) {
+    /* Dropshadows overflow into the neighbouring rows */
+    if (menu->dropshadow || menu->nonuniform_items)
+      return -1;
 
-    /* Move to the next item position */
+    cairo_utils_get_surface_size (menu->surface, &width, &height);
     if (menu->columns != -1) {
-      /* Filling the rows from left to right */
-      column++;
-      if (column < menu->columns) {
-        x += item->width + menu->pad_x;
-        y -= menu->pad_y;
-      } else {
-        row++;
-        column = start_column;
-        x = 0;
-        y += item->height + menu->pad_y;
-      }
-      i = (menu->columns * row) + column;
+      line = menu->columns;
+      pitch = menu->default_item_height + (2 * menu->pad_y);
+      size = height;
     } else {
-      /* Filling the columns from top to bottom */
-      row++;
-      if (row < menu->rows) {
-        x -= menu->pad_x;
-        y += item->height + menu->pad_y;
-      } else {
-        column++;
-        row = start_row;
-        x += item->width + menu->pad_x;
-        y = 0;
-      }
-      i = (menu->rows * column) + row;
+      line = menu->rows;
+      pitch = menu->default_item_width + (2 * menu->pad_x);
+      size = width;
     }
+    if ((delta != line && delta != -line) || pitch >= size)
+      return -1;
+
+    if (cairo_utils_image_surface_scroll (menu->surface,
+            menu->columns != -1 ? 0 : (delta > 0 ? -pitch : pitch),
+            menu->columns != -1 ? (delta > 0 ? -pitch : pitch) : 0) != 0)
+      return -1;
+
+    if (delta > 0) {
+      /* The last row was only partly visible before, redraw it too */
+      start = ((size - pitch) / pitch) * pitch;
+      end = size;
+      first = menu->start_item + (start / pitch) * line;
+      last = menu->nitems - 1;
+    } else {
+      start = 0;
+      end = pitch;
+      first = menu->start_item;
+      last = first + line - 1;
+    }
+
+    cairo_save (cr);
+    if (menu->columns != -1)
+      cairo_rectangle (cr, 0, start, width, end - start);
+    else
+      cairo_rectangle (cr, start, 0, end - start, height);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_fill (cr);
+    cairo_restore (cr);
+
+    _draw_items (menu, cr, first, last);
+  }
+
+  /* Items appended since, only the visible ones get drawn */
+  if (menu->drawn_nitems < menu->nitems)
+    _draw_items (menu, cr, menu->drawn_nitems, menu->nitems - 1);
+
+  if (menu->drawn_selection != menu->selection) {
+    _draw_items (menu, cr, menu->drawn_selection, menu->drawn_selection);
+    _draw_items (menu, cr, menu->selection, menu->selection);
+  }
+
+  return 0;
+}
+
+void
+cairo_menu_redraw (CairoMenu *menu)
+{
+  cairo_t *cr;
 
-    cairo_reset_clip (cr);
+  /* Items may have been modified */
+  if (menu->dirty != CAIRO_MENU_DIRTY_SELECTION)
+    _cache_clear (menu);
+
+  cr = cairo_create (menu->surface);
+
+  if (menu->dirty != CAIRO_MENU_DIRTY_SELECTION ||
+      _redraw_moved (menu, cr) != 0) {
+    /* Clear the whole surface before redrawing */
+    cairo_save (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    cairo_restore (cr);
+
+    _draw_items (menu, cr, -1, -1);
+  }
+
+  cairo_destroy (cr);
+  cairo_surface_flush (menu->surface);
+  menu->drawn_start_item = menu->start_item;
+  menu->drawn_selection = menu->selection;
+  menu->drawn_nitems = menu->nitems;
+  menu->dirty = FALSE;
+}
+
+void
+cairo_menu_redraw_item (CairoMenu *menu, int item_index)
+{
+  cairo_menu_redraw_item_area (menu, item_index, NULL);
+}
+
+void
+cairo_menu_redraw_item_area (CairoMenu *menu, int item_index,
+    CairoMenuRectangle *area)
+{
+  CairoMenuRectangle rect;
+  cairo_t *cr;
+
+  _cache_invalidate (menu, item_index);
+
+  /* Everything needs to be drawn anyway, and not only what moved */
+  if (menu->dirty) {
+    menu->dirty = TRUE;
+    cairo_menu_redraw (menu);
+    return;
+  }
+
+  if (item_index < menu->start_item || item_index >= menu->nitems)
+    return;
+
+  cr = cairo_create (menu->surface);
+  if (area) {
+    /* The item drawing only narrows the clip, until it resets it at the
+     * end of the item */
+    cairo_menu_get_item_rect (menu, item_index, &rect);
+    cairo_rectangle (cr, rect.x + area->x, rect.y + area->y,
+        area->width, area->height);
+    cairo_clip (cr);
   }
+  _draw_items (menu, cr, item_index, item_index);
   cairo_destroy (cr);
   cairo_surface_flush (menu->surface);
 }
@@ -825,7 +1746,6 @@ cairo_menu_free (CairoMenu *menu)
       CairoMenuItem *item = &menu->items[i];
       if (item->image)
         cairo_surface_destroy (item->image);
-      free (item->text);
       if (item->bg_image)
         cairo_surface_destroy (item->bg_image);
       if (item->bg_sel_image)
@@ -833,6 +1753,13 @@ cairo_menu_free (CairoMenu *menu)
     }
     free (menu->items);
   }
+  arena_clear (&menu->arena);
+  free (menu->next_enabled);
+  free (menu->prev_enabled);
+  free (menu->row_offsets);
+  free (menu->column_offsets);
+  _cache_clear (menu);
+  free (menu->cache);
 
   cairo_surface_destroy (menu->surface);
   if (menu->bg_image)
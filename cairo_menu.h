@@ -23,6 +23,7 @@
 #define __CAIRO_MENU_H__
 
 #include <cairo/cairo.h>
+#include "arena.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -82,8 +83,12 @@ typedef enum {
  * @CAIRO_MENU_INPUT_DOWN: Move the selection one row down
  * @CAIRO_MENU_INPUT_LEFT: Move the selection one column to the left
  * @CAIRO_MENU_INPUT_RIGHT: Move the selection one column to the right
+ * @CAIRO_MENU_INPUT_PAGE_UP: Move the selection one screen back
+ * @CAIRO_MENU_INPUT_PAGE_DOWN: Move the selection one screen forward
+ * @CAIRO_MENU_INPUT_HOME: Move the selection to the first item
+ * @CAIRO_MENU_INPUT_END: Move the selection to the last item
  *
- * Defines the four possible input that the menu can handle for changing the
+ * Defines the possible input that the menu can handle for changing the
  * selection
  */
 typedef enum {
@@ -91,6 +96,10 @@ typedef enum {
   CAIRO_MENU_INPUT_DOWN,
   CAIRO_MENU_INPUT_LEFT,
   CAIRO_MENU_INPUT_RIGHT,
+  CAIRO_MENU_INPUT_PAGE_UP,
+  CAIRO_MENU_INPUT_PAGE_DOWN,
+  CAIRO_MENU_INPUT_HOME,
+  CAIRO_MENU_INPUT_END,
 } CairoMenuInput;
 
 /**
@@ -183,6 +192,10 @@ typedef struct {
 
 typedef struct _CairoMenuItem CairoMenuItem;
 typedef struct _CairoMenu CairoMenu;
+typedef struct _CairoMenuCachedItem CairoMenuCachedItem;
+
+/* Value of #CairoMenu:dirty when only the selection or scrolling changed */
+#define CAIRO_MENU_DIRTY_SELECTION 2
 
 /**
  * CairoMenuDrawItemCb:
@@ -243,8 +256,25 @@ struct _CairoMenuItem {
   cairo_surface_t *bg_sel_image;
   /* Private - you can read, but don't modify */
   int index;
+  size_t text_allocated;
 };
 
+/**
+ * CairoMenuItemProviderCb:
+ * @menu: The menu
+ * @item: The item to fill
+ * @user_data: The user data given to cairo_menu_set_item_provider()
+ *
+ * Called by a virtual menu whenever it needs the item at index @item->index,
+ * to draw it or to check whether it can be selected. @item comes filled with
+ * the default values of cairo_menu_add_item(), set its text and anything else
+ * that needs changing. The menu doesn't take ownership of the text or images
+ * set in @item, they only need to stay valid until the provider gets called
+ * again.
+ */
+typedef void (*CairoMenuItemProviderCb) (CairoMenu *menu, CairoMenuItem *item,
+    void *user_data);
+
 /**
  * CairoMenu:
  * @surface: The surface where the menu gets drawn
@@ -258,11 +288,35 @@ struct _CairoMenuItem {
  * @bg_image: The default background image for non selected items
  * @bg_sel_image: The default background image for selected items
  * @disabled_image: An image to overlay on top of disabled items
+ * @dirty: #TRUE if the surface is out of date and needs a cairo_menu_redraw().
+ * Set it if you modify one of the menu's items directly. It is
+ * %CAIRO_MENU_DIRTY_SELECTION if only the selection or the scrolling changed,
+ * in which case the redraw reuses what was already drawn.
  * @nitems: Number of items in the menu
  * @items: The items in the menu
  * @selection: Currently selected item index
  * @start_item: The first item to be drawn (!= 0 if scrolled)
  * @dropshadow: A surface with the dropshadow to apply to all items.
+ * @allocated_items: The number of items that @items has room for
+ * @provider: The callback providing the items of a virtual menu
+ * @provider_data: The user data for @provider
+ * @provider_text_size: The default text size of virtual items
+ * @virtual_item: The last item returned by @provider
+ * @arena: Owns the text of the items, released by cairo_menu_free()
+ * @next_enabled: For each item, the first enabled item at or after it, or -1
+ * @prev_enabled: For each item, the last enabled item at or before it, or -1
+ * @skip_valid: Whether @next_enabled and @prev_enabled are up to date
+ * @nonuniform_items: Set if any item doesn't have the default size
+ * @drawn_start_item: The @start_item when the surface was last drawn
+ * @drawn_selection: The @selection when the surface was last drawn
+ * @drawn_nitems: The @nitems when the surface was last drawn
+ * @cache_pages: How many pages of items to keep rendered, 0 for no cache
+ * @cache: The rendered items, indexed by item index modulo @ncache
+ * @ncache: The number of slots in @cache
+ * @row_offsets: Offset of each row and the total height, when the items
+ * don't all have the default size, or #NULL
+ * @column_offsets: Offset of each column and the total width, or #NULL
+ * @layout_valid: Whether @row_offsets and @column_offsets are up to date
  */
 struct _CairoMenu {
   cairo_surface_t *surface;
@@ -276,12 +330,32 @@ struct _CairoMenu {
   cairo_surface_t *bg_image;
   cairo_surface_t *bg_sel_image;
   cairo_surface_t *disabled_image;
+  int dirty;
   /* Private - can read but don't modify */
   int nitems;
   CairoMenuItem *items;
   int selection;
   int start_item;
   cairo_surface_t *dropshadow;
+  int allocated_items;
+  CairoMenuItemProviderCb provider;
+  void *provider_data;
+  int provider_text_size;
+  CairoMenuItem virtual_item;
+  arena_t arena;
+  int *next_enabled;
+  int *prev_enabled;
+  int skip_valid;
+  int nonuniform_items;
+  int drawn_start_item;
+  int drawn_selection;
+  int drawn_nitems;
+  int cache_pages;
+  CairoMenuCachedItem *cache;
+  int ncache;
+  int *row_offsets;
+  int *column_offsets;
+  int layout_valid;
 };
 
 /**
@@ -303,10 +377,10 @@ struct _CairoMenu {
  *
  <note>
    <para>
-   An item's width and height can always be modified after adding the item to
-   the menu, however, if the width and height of each item is different and the
-   menu has more than one row or column, then the behavior is undetermined.
-   It is best to use the same width/height for all the items in the menu.
+   An item's width and height can be modified after adding the item to the
+   menu with cairo_menu_set_item_size(). Each row is as tall as its tallest
+   item and each column as wide as its widest item. Menus where all the items
+   have the same size are cheaper to lay out and scroll.
    </para>
  </note>
  *
@@ -407,6 +481,140 @@ int cairo_menu_add_item_full (CairoMenu *menu, cairo_surface_t *image,
     cairo_surface_t *bg_image, cairo_surface_t *bg_sel_image,
     CairoMenuDrawItemCb draw_cb, void *draw_data);
 
+/**
+ * cairo_menu_set_item_provider:
+ * @menu: The menu
+ * @nitems: The number of items in the menu
+ * @text_size: The default text size for the items
+ * @provider: The callback providing the items
+ * @user_data: User data for @provider
+ *
+ * Turn @menu into a virtual menu of @nitems items. Instead of storing every
+ * item, @provider gets asked for an item only when it becomes visible or when
+ * the selection moves to it, which lets menus with a huge number of items
+ * start instantly. No items can be added to a virtual menu.
+ */
+void cairo_menu_set_item_provider (CairoMenu *menu, int nitems, int text_size,
+    CairoMenuItemProviderCb provider, void *user_data);
+
+/**
+ * cairo_menu_set_item_count:
+ * @menu: The virtual menu
+ * @nitems: The new number of items
+ *
+ * Change how many items a menu set up with cairo_menu_set_item_provider()
+ * has, without moving the selection or the scroll position. When items are
+ * appended, only the ones that are visible get drawn by the next
+ * cairo_menu_redraw(), and the menu is only marked as dirty if any of them
+ * is visible. This does nothing for menus without a provider.
+ */
+void cairo_menu_set_item_count (CairoMenu *menu, int nitems);
+
+/**
+ * cairo_menu_get_item:
+ * @menu: The menu
+ * @item_index: The index of the item
+ *
+ * Get an item of the menu, which works for virtual menus as well. For those,
+ * the returned item is only valid until the next call.
+ *
+ * Returns: The item at @item_index
+ */
+CairoMenuItem *cairo_menu_get_item (CairoMenu *menu, int item_index);
+
+/**
+ * cairo_menu_set_item_text:
+ * @menu: The menu
+ * @item_index: The index of the item
+ * @text: The new text of the item or #NULL
+ *
+ * Replaces the text of an item. The text of the items is owned by the menu,
+ * so use this instead of freeing and setting @text in #CairoMenuItem.
+ * Virtual menus get their text from their provider, so this does nothing
+ * for them.
+ */
+void cairo_menu_set_item_text (CairoMenu *menu, int item_index, const char *text);
+
+/**
+ * cairo_menu_set_item_enabled:
+ * @menu: The menu
+ * @item_index: The index of the item
+ * @enabled: Whether the item can be selected
+ *
+ * Enables or disables an item. Use this instead of changing @enabled in
+ * #CairoMenuItem, so that the menu knows which items it needs to skip.
+ * Virtual menus get this from their provider, so this does nothing for them.
+ */
+void cairo_menu_set_item_enabled (CairoMenu *menu, int item_index, int enabled);
+
+/**
+ * cairo_menu_set_item_size:
+ * @menu: The menu
+ * @item_index: The index of the item
+ * @width: The new width of the item
+ * @height: The new height of the item
+ *
+ * Resizes an item. The rows and columns of the menu grow to fit their largest
+ * item, so items may have different sizes. Items of virtual menus all have
+ * the default size, so this does nothing for them.
+ */
+void cairo_menu_set_item_size (CairoMenu *menu, int item_index,
+    int width, int height);
+
+/**
+ * cairo_menu_get_scroll:
+ * @menu: The menu
+ * @x: Set to the horizontal scroll position, in pixels
+ * @y: Set to the vertical scroll position, in pixels
+ *
+ * Get how far the menu is scrolled, as the position of the first visible row
+ * and column from the start of the menu.
+ */
+void cairo_menu_get_scroll (CairoMenu *menu, int *x, int *y);
+
+/**
+ * cairo_menu_scroll_to:
+ * @menu: The menu
+ * @x: The horizontal scroll position, in pixels
+ * @y: The vertical scroll position, in pixels
+ *
+ * Scroll the menu so the view starts at the row and column closest to
+ * (@x, @y), without going past the end of the menu. The selection is left
+ * unchanged, even if it scrolls out of view. Like cairo_menu_select(), this
+ * only marks the menu as dirty if anything changed.
+ *
+ * Returns: #TRUE if the menu scrolled
+ */
+int cairo_menu_scroll_to (CairoMenu *menu, int x, int y);
+
+/**
+ * cairo_menu_get_item_at:
+ * @menu: The menu
+ * @x: The horizontal position in the menu's surface
+ * @y: The vertical position in the menu's surface
+ *
+ * Find the item drawn at a point of the surface, taking scrolling into
+ * account.
+ *
+ * Returns: The index of the item at (@x, @y) or -1 if there is none
+ */
+int cairo_menu_get_item_at (CairoMenu *menu, int x, int y);
+
+/**
+ * cairo_menu_get_item_rect:
+ * @menu: The menu
+ * @item_index: The index of the item
+ * @rect: Filled with the area of the surface where the item is drawn
+ *
+ * Get the position of an item in the menu's surface, taking scrolling into
+ * account. The position may be outside of the surface if the item isn't
+ * visible.
+ *
+ * Returns: #TRUE if @rect was filled, #FALSE if @item_index is invalid
+ */
+int cairo_menu_get_item_rect (CairoMenu *menu, int item_index,
+    CairoMenuRectangle *rect);
+
 /**
  * cairo_menu_set_item_image:
  * @menu: The menu containing the item
@@ -422,10 +630,26 @@ int cairo_menu_add_item_full (CairoMenu *menu, cairo_surface_t *image,
  * If you set the image surface directly into @item, then it will simply
  * be overlayed on top of the item without any kind of scaling.
  * After this function returns, @image will not be used, and can be destroyed.
+ * Virtual menus get their images from their provider, so this does nothing
+ * for them.
  */
 void cairo_menu_set_item_image (CairoMenu *menu, int item_index, cairo_surface_t *image,
     CairoMenuImagePosition image_position);
 
+/**
+ * cairo_menu_move_selection:
+ * @menu: The menu to change its selection
+ * @input: The input received by the Pad
+ *
+ * Change the selection according to the controller input, skipping disabled
+ * items, without drawing anything. If the selection or the scrolling changed,
+ * the menu is marked as dirty and a single cairo_menu_redraw() will bring the
+ * surface up to date, no matter how many inputs were handled before it.
+ *
+ * Returns: The id of the currently selected menu item
+ */
+int cairo_menu_move_selection (CairoMenu *menu, CairoMenuInput input);
+
 /**
  * cairo_menu_handle_input:
  * @menu: The menu to change its selection
@@ -441,6 +665,19 @@ void cairo_menu_set_item_image (CairoMenu *menu, int item_index, cairo_surface_t
 int cairo_menu_handle_input (CairoMenu *menu, CairoMenuInput input,
     CairoMenuRectangle *bbox);
 
+/**
+ * cairo_menu_select:
+ * @menu: The menu to change its selection
+ * @id: The id of the item to select
+ *
+ * Select an item and scroll so that it is visible, without drawing anything.
+ * Like cairo_menu_move_selection(), the menu is marked as dirty if anything
+ * changed.
+ *
+ * Returns: @id, or -1 if the item is disabled
+ */
+int cairo_menu_select (CairoMenu *menu, int id);
+
 /**
  * cairo_menu_set_selection:
  * @menu: The menu to change its selection
@@ -448,11 +685,37 @@ int cairo_menu_handle_input (CairoMenu *menu, CairoMenuInput input,
  * @bbox: The dirty rectangle of the surface
  *
  * Changes the current selection of the menu, causing a possible redraw of the
- * surface. If a drawing operation is needed, the @bbox rectangle will be
+ * surface. The menu is scrolled so that the new selection is visible.
+ * If a drawing operation is needed, the @bbox rectangle will be
  * updated with the area that is marked dirty
  */
 void cairo_menu_set_selection (CairoMenu *menu, int id, CairoMenuRectangle *bbox);
 
+/**
+ * cairo_menu_set_cache_pages:
+ * @menu: The menu
+ * @pages: How many pages worth of items to keep rendered, 0 to disable
+ *
+ * Keep a rendering of the items that are not selected so that scrolling them
+ * back into view only needs a copy. Items with their own @draw_cb are never
+ * cached. Call cairo_menu_redraw_item() or mark the menu as dirty after
+ * modifying an item so its rendering gets refreshed.
+ */
+void cairo_menu_set_cache_pages (CairoMenu *menu, int pages);
+
+/**
+ * cairo_menu_prefetch:
+ * @menu: The menu
+ * @budget_us: How long to spend at most, in microseconds
+ *
+ * Render the items of the pages before and after the visible one into the
+ * item cache, so they are ready when the menu gets scrolled. This is meant
+ * to be called when idle, it stops once @budget_us is spent.
+ *
+ * Returns: #TRUE if there are items left to render
+ */
+int cairo_menu_prefetch (CairoMenu *menu, int budget_us);
+
 /**
  * cairo_menu_redraw:
  * @menu: The menu to draw
@@ -461,6 +724,29 @@ void cairo_menu_set_selection (CairoMenu *menu, int id, CairoMenuRectangle *bbox
  */
 void cairo_menu_redraw (CairoMenu *menu);
 
+/**
+ * cairo_menu_redraw_item:
+ * @menu: The menu to draw
+ * @item_index: The index of the item to draw
+ *
+ * Redraw a single item in place, after its text or images were modified,
+ * leaving the rest of the surface untouched. If the menu is marked as dirty,
+ * then the entire menu gets redrawn instead.
+ */
+void cairo_menu_redraw_item (CairoMenu *menu, int item_index);
+
+/**
+ * cairo_menu_redraw_item_area:
+ * @menu: The menu to draw
+ * @item_index: The index of the item to draw
+ * @area: The part of the item to draw, relative to the item
+ *
+ * Same as cairo_menu_redraw_item(), but only the pixels within @area are
+ * touched, for when a change is limited to a small part of the item.
+ */
+void cairo_menu_redraw_item_area (CairoMenu *menu, int item_index,
+    CairoMenuRectangle *area);
+
 /**
  * cairo_menu_get_surface:
  * @menu: The menu
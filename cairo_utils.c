@@ -196,3 +196,45 @@ cairo_utils_surface_add_dropshadow (cairo_surface_t *surface, int radius)
 
   return result;
 }
+
+int
+cairo_utils_image_surface_scroll (cairo_surface_t *surface, int dx, int dy)
+{
+  unsigned char *data;
+  int width, height, stride;
+  int y;
+
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+    return -1;
+  if (cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32 &&
+      cairo_image_surface_get_format (surface) != CAIRO_FORMAT_RGB24)
+    return -1;
+
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+  stride = cairo_image_surface_get_stride (surface);
+  if (abs (dx) >= width || abs (dy) >= height)
+    return -1;
+
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+
+  /* The rows are contiguous so a vertical scroll is a single move */
+  if (dy > 0)
+    memmove (data + (dy * stride), data, (height - dy) * stride);
+  else if (dy < 0)
+    memmove (data, data - (dy * stride), (height + dy) * stride);
+
+  for (y = 0; dx != 0 && y < height; y++) {
+    unsigned char *row = data + (y * stride);
+
+    if (dx > 0)
+      memmove (row + (dx * 4), row, (width - dx) * 4);
+    else
+      memmove (row, row - (dx * 4), (width + dx) * 4);
+  }
+
+  cairo_surface_mark_dirty (surface);
+
+  return 0;
+}
@@ -133,4 +133,19 @@ void cairo_utils_image_surface_blur (cairo_surface_t* surface, double radius);
 cairo_surface_t *cairo_utils_surface_add_dropshadow (cairo_surface_t *surface,
     int radius);
 
+/**
+ * cairo_utils_image_surface_scroll:
+ * @surface: The image surface to scroll
+ * @dx: How many pixels to move the content to the right, negative for left
+ * @dy: How many pixels to move the content down, negative for up
+ *
+ * Moves the pixels of the surface in place. The area that gets uncovered keeps
+ * its old content, it's up to the caller to redraw it.
+ * Only one of @dx or @dy can be non zero.
+ *
+ * Returns: 0 on success, -1 if @surface isn't a 32 bits image surface or
+ * the offset is larger than the surface.
+ */
+int cairo_utils_image_surface_scroll (cairo_surface_t *surface, int dx, int dy);
+
 #endif /* __CAIRO_UTILS_H__ */
@@ -0,0 +1,466 @@
+/*
+ * evdev_input.c : Linux evdev keyboard and pointer input
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "evdev_input.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/input.h>
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NLONGS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define TEST_BIT(bit, array) \
+  ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+typedef enum {
+  POINTER_NONE = 0,
+  POINTER_RELATIVE,
+  POINTER_ABSOLUTE,
+} evdev_pointer_type;
+
+typedef struct {
+  int fd;
+  int dropped;
+  char path[PATH_MAX];
+  int keyboard;
+  evdev_pointer_type pointer;
+  /* ABS_X/ABS_Y, or the multitouch axes of the first slot if the device
+   * doesn't emulate a single touch */
+  int abs_x;
+  int abs_y;
+  struct input_absinfo x_info;
+  struct input_absinfo y_info;
+  int slot;
+  int x;
+  int y;
+  int pressed;
+  int changed;
+} evdev_device_t;
+
+struct _evdev_input {
+  event_loop_t *loop;
+  int inotify_fd;
+  evdev_device_t *devices;
+  int ndevices;
+  evdev_input_key_cb key_cb;
+  evdev_input_pointer_cb pointer_cb;
+  void *user_data;
+  int width;
+  int height;
+};
+
+static int
+_is_keyboard (int fd)
+{
+  unsigned long evbits[NLONGS(EV_CNT)] = {0};
+  unsigned long keybits[NLONGS(KEY_CNT)] = {0};
+
+  if (ioctl (fd, EVIOCGBIT(0, sizeof(evbits)), evbits) < 0 ||
+      !TEST_BIT(EV_KEY, evbits))
+    return 0;
+
+  if (ioctl (fd, EVIOCGBIT(EV_KEY, sizeof(keybits)), keybits) < 0)
+    return 0;
+
+  /* Power buttons and such also report EV_KEY, we only want devices that
+   * can actually navigate a menu */
+  return TEST_BIT(KEY_ENTER, keybits) && TEST_BIT(KEY_UP, keybits) &&
+      TEST_BIT(KEY_DOWN, keybits);
+}
+
+/* Find out if the device can move a pointer, and which axes to use */
+static evdev_pointer_type
+_get_pointer_type (evdev_device_t *device)
+{
+  unsigned long evbits[NLONGS(EV_CNT)] = {0};
+  unsigned long bits[NLONGS(KEY_CNT)] = {0};
+  unsigned long props[NLONGS(INPUT_PROP_CNT)] = {0};
+
+  if (ioctl (device->fd, EVIOCGBIT(0, sizeof(evbits)), evbits) < 0)
+    return POINTER_NONE;
+
+  if (TEST_BIT(EV_ABS, evbits) &&
+      ioctl (device->fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) >= 0) {
+    /* Touchpads report absolute positions too, but they aren't mapped to
+     * the screen, and neither are accelerometers, joysticks or gamepads, so
+     * only take touchscreens */
+    if (ioctl (device->fd, EVIOCGPROP(sizeof(props)), props) < 0)
+      memset (props, 0, sizeof(props));
+    if (TEST_BIT(INPUT_PROP_POINTER, props) ||
+        TEST_BIT(INPUT_PROP_ACCELEROMETER, props))
+      return POINTER_NONE;
+    if (!TEST_BIT(INPUT_PROP_DIRECT, props)) {
+      unsigned long keybits[NLONGS(KEY_CNT)] = {0};
+
+      if (!TEST_BIT(EV_KEY, evbits) ||
+          ioctl (device->fd, EVIOCGBIT(EV_KEY, sizeof(keybits)), keybits) < 0 ||
+          !TEST_BIT(BTN_TOUCH, keybits))
+        return POINTER_NONE;
+    }
+
+    if (TEST_BIT(ABS_X, bits) && TEST_BIT(ABS_Y, bits)) {
+      device->abs_x = ABS_X;
+      device->abs_y = ABS_Y;
+    } else if (TEST_BIT(ABS_MT_POSITION_X, bits) &&
+        TEST_BIT(ABS_MT_POSITION_Y, bits)) {
+      device->abs_x = ABS_MT_POSITION_X;
+      device->abs_y = ABS_MT_POSITION_Y;
+    } else {
+      return POINTER_NONE;
+    }
+    if (ioctl (device->fd, EVIOCGABS(device->abs_x), &device->x_info) < 0 ||
+        ioctl (device->fd, EVIOCGABS(device->abs_y), &device->y_info) < 0 ||
+        device->x_info.maximum <= device->x_info.minimum ||
+        device->y_info.maximum <= device->y_info.minimum)
+      return POINTER_NONE;
+
+    return POINTER_ABSOLUTE;
+  }
+
+  memset (bits, 0, sizeof(bits));
+  if (TEST_BIT(EV_REL, evbits) &&
+      ioctl (device->fd, EVIOCGBIT(EV_REL, sizeof(bits)), bits) >= 0 &&
+      TEST_BIT(REL_X, bits) && TEST_BIT(REL_Y, bits))
+    return POINTER_RELATIVE;
+
+  return POINTER_NONE;
+}
+
+static int
+_clamp (int value, int max)
+{
+  if (value < 0)
+    return 0;
+  if (max > 0 && value >= max)
+    return max - 1;
+  return value;
+}
+
+static int
+_scale_abs (int value, struct input_absinfo *info, int size)
+{
+  if (size <= 0)
+    return value;
+  return _clamp ((long long) (value - info->minimum) * size /
+      (info->maximum - info->minimum + 1), size);
+}
+
+static void
+_handle_pointer_event (evdev_device_t *device, struct input_event *ev)
+{
+  switch (ev->type) {
+    case EV_KEY:
+      if (ev->code == BTN_LEFT || ev->code == BTN_TOUCH) {
+        device->pressed = (ev->value != 0);
+        device->changed = 1;
+      }
+      break;
+    case EV_REL:
+      if (ev->code == REL_X)
+        device->x += ev->value;
+      else if (ev->code == REL_Y)
+        device->y += ev->value;
+      else
+        break;
+      device->changed = 1;
+      break;
+    case EV_ABS:
+      if (ev->code == ABS_MT_SLOT) {
+        device->slot = ev->value;
+      } else if (device->abs_x == ABS_MT_POSITION_X && device->slot != 0) {
+        /* Only the first finger is followed */
+      } else if (ev->code == device->abs_x) {
+        device->x = ev->value;
+        device->changed = 1;
+      } else if (ev->code == device->abs_y) {
+        device->y = ev->value;
+        device->changed = 1;
+      } else if (ev->code == ABS_MT_TRACKING_ID &&
+          device->abs_x == ABS_MT_POSITION_X) {
+        device->pressed = (ev->value != -1);
+        device->changed = 1;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+_report_pointer (evdev_input_t *input, evdev_device_t *device)
+{
+  int x, y;
+
+  if (!device->changed)
+    return;
+  device->changed = 0;
+
+  if (device->pointer == POINTER_RELATIVE) {
+    device->x = _clamp (device->x, input->width);
+    device->y = _clamp (device->y, input->height);
+    x = device->x;
+    y = device->y;
+  } else {
+    x = _scale_abs (device->x, &device->x_info, input->width);
+    y = _scale_abs (device->y, &device->y_info, input->height);
+  }
+  input->pointer_cb (x, y, device->pressed,
+      device->pointer == POINTER_RELATIVE, input->user_data);
+}
+
+static void
+_remove_device (evdev_input_t *input, int fd)
+{
+  int i;
+
+  for (i = 0; i < input->ndevices; i++) {
+    if (input->devices[i].fd == fd) {
+      close (fd);
+      input->devices[i] = input->devices[--input->ndevices];
+      break;
+    }
+  }
+}
+
+static evdev_device_t *
+_find_device (evdev_input_t *input, int fd)
+{
+  int i;
+
+  for (i = 0; i < input->ndevices; i++) {
+    if (input->devices[i].fd == fd)
+      return &input->devices[i];
+  }
+
+  return NULL;
+}
+
+static int
+_device_ready (event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  evdev_input_t *input = user_data;
+  evdev_device_t *device = _find_device (input, fd);
+  struct input_event ev[64];
+  int len, i;
+
+  /* Drain everything the device has queued, so a burst of autorepeats
+   * gets handled in one go */
+  for (;;) {
+    len = read (fd, ev, sizeof(ev));
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0 && errno == EAGAIN)
+      return 0;
+    if (len < (int) sizeof(struct input_event)) {
+      /* Device was unplugged */
+      _remove_device (input, fd);
+      return -1;
+    }
+
+    for (i = 0; i < len / (int) sizeof(struct input_event); i++) {
+      /* The kernel buffer overflowed, everything up to the next report is
+       * incomplete so drop it */
+      if (ev[i].type == EV_SYN) {
+        if (ev[i].code == SYN_DROPPED) {
+          device->dropped = 1;
+        } else if (ev[i].code == SYN_REPORT) {
+          /* Positions are absolute or accumulated, so the report after a
+           * drop still brings the pointer to the right place */
+          if (device->pointer && !device->dropped)
+            _report_pointer (input, device);
+          device->dropped = 0;
+        }
+      } else if (device->dropped) {
+        continue;
+      } else if (device->pointer) {
+        _handle_pointer_event (device, &ev[i]);
+        if (ev[i].type == EV_KEY && device->keyboard &&
+            ev[i].code != BTN_LEFT && ev[i].code != BTN_TOUCH)
+          input->key_cb (ev[i].code, ev[i].value, input->user_data);
+      } else if (ev[i].type == EV_KEY) {
+        input->key_cb (ev[i].code, ev[i].value, input->user_data);
+      }
+    }
+
+    if (len < (int) sizeof(ev))
+      return 0;
+  }
+}
+
+static void
+_add_device (evdev_input_t *input, const char *name)
+{
+  evdev_device_t *devices;
+  evdev_device_t device;
+  char path[PATH_MAX];
+  int fd, i;
+
+  if (strncmp (name, "event", 5) != 0)
+    return;
+
+  snprintf (path, sizeof(path), "%s/%s", EVDEV_INPUT_DIRECTORY, name);
+  for (i = 0; i < input->ndevices; i++) {
+    if (strcmp (input->devices[i].path, path) == 0)
+      return;
+  }
+
+  fd = open (path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  memset (&device, 0, sizeof(evdev_device_t));
+  device.fd = fd;
+  device.keyboard = _is_keyboard (fd);
+  if (input->pointer_cb)
+    device.pointer = _get_pointer_type (&device);
+  if (!device.keyboard && !device.pointer)
+    goto error;
+
+  /* Mice start at the center of the screen */
+  if (device.pointer == POINTER_RELATIVE) {
+    device.x = input->width / 2;
+    device.y = input->height / 2;
+  }
+
+  devices = realloc (input->devices,
+      (input->ndevices + 1) * sizeof(evdev_device_t));
+  if (devices == NULL)
+    goto error;
+  input->devices = devices;
+
+  if (event_loop_add_fd (input->loop, fd, POLLIN, _device_ready, input) != 0)
+    goto error;
+
+  strcpy (device.path, path);
+  input->devices[input->ndevices++] = device;
+
+  return;
+ error:
+  close (fd);
+}
+
+static int
+_inotify_ready (event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  evdev_input_t *input = user_data;
+  char buffer[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  int len, i;
+
+  len = read (fd, buffer, sizeof(buffer));
+  if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    return 0;
+  if (len <= 0)
+    return -1;
+
+  for (i = 0; i < len;) {
+    struct inotify_event *event = (struct inotify_event *) &buffer[i];
+
+    /* The node is usually created before udev fixes its permissions, so
+     * try again when its attributes change */
+    if (event->len > 0 && (event->mask & (IN_CREATE | IN_ATTRIB)))
+      _add_device (input, event->name);
+    i += sizeof(struct inotify_event) + event->len;
+  }
+
+  return 0;
+}
+
+evdev_input_t *
+evdev_input_new (event_loop_t *loop, evdev_input_key_cb key_cb,
+    evdev_input_pointer_cb pointer_cb, void *user_data)
+{
+  evdev_input_t *input;
+  struct dirent *entry;
+  DIR *dir;
+
+  input = malloc (sizeof(evdev_input_t));
+  if (input == NULL)
+    return NULL;
+
+  memset (input, 0, sizeof(evdev_input_t));
+  input->loop = loop;
+  input->key_cb = key_cb;
+  input->pointer_cb = pointer_cb;
+  input->user_data = user_data;
+
+  /* Start watching before enumerating so we don't miss a device that gets
+   * plugged in between the two */
+  input->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (input->inotify_fd >= 0) {
+    if (inotify_add_watch (input->inotify_fd, EVDEV_INPUT_DIRECTORY,
+            IN_CREATE | IN_ATTRIB) < 0 ||
+        event_loop_add_fd (loop, input->inotify_fd, POLLIN,
+            _inotify_ready, input) != 0) {
+      close (input->inotify_fd);
+      input->inotify_fd = -1;
+    }
+  }
+
+  dir = opendir (EVDEV_INPUT_DIRECTORY);
+  if (dir) {
+    while ((entry = readdir (dir)) != NULL)
+      _add_device (input, entry->d_name);
+    closedir (dir);
+  }
+
+  return input;
+}
+
+void
+evdev_input_free (evdev_input_t *input)
+{
+  int i;
+
+  for (i = 0; i < input->ndevices; i++) {
+    event_loop_remove_fd (input->loop, input->devices[i].fd);
+    close (input->devices[i].fd);
+  }
+  if (input->inotify_fd >= 0) {
+    event_loop_remove_fd (input->loop, input->inotify_fd);
+    close (input->inotify_fd);
+  }
+  free (input->devices);
+  free (input);
+}
+
+void
+evdev_input_set_screen_size (evdev_input_t *input, int width, int height)
+{
+  int i;
+
+  input->width = width;
+  input->height = height;
+  for (i = 0; i < input->ndevices; i++) {
+    if (input->devices[i].pointer == POINTER_RELATIVE) {
+      input->devices[i].x = width / 2;
+      input->devices[i].y = height / 2;
+    }
+  }
+}
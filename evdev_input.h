@@ -0,0 +1,70 @@
+/*
+ * evdev_input.h : Linux evdev keyboard and pointer input
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __EVDEV_INPUT_H__
+#define __EVDEV_INPUT_H__
+
+#include "event_loop.h"
+
+#define EVDEV_INPUT_DIRECTORY "/dev/input"
+
+typedef struct _evdev_input evdev_input_t;
+
+/**
+ * evdev_input_key_cb:
+ * @code: The KEY_* code from <linux/input.h>
+ * @value: 1 for a key press, 2 for an autorepeat, 0 for a release
+ * @user_data: The user data given to evdev_input_new()
+ *
+ * Called for every key event received from any of the keyboards.
+ */
+typedef void (*evdev_input_key_cb) (int code, int value, void *user_data);
+
+/**
+ * evdev_input_pointer_cb:
+ * @x: The horizontal position on the screen
+ * @y: The vertical position on the screen
+ * @pressed: Whether the screen is touched or the left button is held
+ * @relative: Whether it comes from a mouse rather than a touchscreen
+ * @user_data: The user data given to evdev_input_new()
+ *
+ * Called once per report of a mouse or touchscreen when its position or
+ * state changed. Mice move a cursor that starts at the center of the screen.
+ */
+typedef void (*evdev_input_pointer_cb) (int x, int y, int pressed,
+    int relative, void *user_data);
+
+/*
+ * Open every keyboard found in EVDEV_INPUT_DIRECTORY, along with mice and
+ * touchscreens if @pointer_cb isn't NULL, and watch the directory for devices
+ * being plugged in later. Returns NULL on error.
+ */
+evdev_input_t *evdev_input_new (event_loop_t *loop,
+    evdev_input_key_cb key_cb, evdev_input_pointer_cb pointer_cb,
+    void *user_data);
+void evdev_input_free (evdev_input_t *input);
+
+/*
+ * Set the size of the screen that pointer positions are mapped to. Until
+ * then, touchscreens report their raw coordinates.
+ */
+void evdev_input_set_screen_size (evdev_input_t *input, int width, int height);
+
+#endif /* __EVDEV_INPUT_H__ */
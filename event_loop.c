@@ -0,0 +1,351 @@
+/*
+ * event_loop.c : poll() based event loop
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "event_loop.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+typedef enum {
+  SOURCE_FD,
+  SOURCE_TIMER,
+  SOURCE_SIGNAL,
+} event_source_type;
+
+typedef struct {
+  event_source_type type;
+  int fd;
+  short events;
+  int signum;
+  int removed;
+  union {
+    event_loop_fd_cb fd;
+    event_loop_timer_cb timer;
+    event_loop_signal_cb signal;
+  } callback;
+  void *user_data;
+} event_source_t;
+
+struct _event_loop {
+  event_source_t *sources;
+  struct pollfd *pollfds;
+  int nsources;
+  int allocated;
+  int dispatching;
+};
+
+event_loop_t *
+event_loop_new (void)
+{
+  event_loop_t *loop = malloc (sizeof(event_loop_t));
+
+  if (loop == NULL)
+    return NULL;
+
+  memset (loop, 0, sizeof(event_loop_t));
+
+  return loop;
+}
+
+static void
+_source_release (event_source_t *source)
+{
+  sigset_t mask;
+
+  if (source->type == SOURCE_TIMER) {
+    close (source->fd);
+  } else if (source->type == SOURCE_SIGNAL) {
+    close (source->fd);
+    sigemptyset (&mask);
+    sigaddset (&mask, source->signum);
+    sigprocmask (SIG_UNBLOCK, &mask, NULL);
+  }
+}
+
+void
+event_loop_free (event_loop_t *loop)
+{
+  int i;
+
+  for (i = 0; i < loop->nsources; i++) {
+    if (!loop->sources[i].removed)
+      _source_release (&loop->sources[i]);
+  }
+  free (loop->sources);
+  free (loop->pollfds);
+  free (loop);
+}
+
+static event_source_t *
+_find_source (event_loop_t *loop, int fd)
+{
+  int i;
+
+  for (i = 0; i < loop->nsources; i++) {
+    if (loop->sources[i].fd == fd && !loop->sources[i].removed)
+      return &loop->sources[i];
+  }
+
+  return NULL;
+}
+
+static event_source_t *
+_add_source (event_loop_t *loop, event_source_type type, int fd,
+    short events, void *user_data)
+{
+  event_source_t *source;
+
+  if (loop->nsources == loop->allocated) {
+    int allocated = loop->allocated ? loop->allocated * 2 : 8;
+    event_source_t *sources;
+    struct pollfd *pollfds;
+
+    sources = realloc (loop->sources, allocated * sizeof(event_source_t));
+    if (sources == NULL)
+      return NULL;
+    loop->sources = sources;
+    pollfds = realloc (loop->pollfds, allocated * sizeof(struct pollfd));
+    if (pollfds == NULL)
+      return NULL;
+    loop->pollfds = pollfds;
+    loop->allocated = allocated;
+  }
+
+  source = &loop->sources[loop->nsources++];
+  memset (source, 0, sizeof(event_source_t));
+  source->type = type;
+  source->fd = fd;
+  source->events = events;
+  source->user_data = user_data;
+
+  return source;
+}
+
+/* Sources can't be removed from the array while it's being iterated on,
+ * so removal only marks them, and we compact it once dispatching is done */
+static void
+_compact_sources (event_loop_t *loop)
+{
+  int i, j;
+
+  for (i = 0, j = 0; i < loop->nsources; i++) {
+    if (loop->sources[i].removed)
+      continue;
+    if (i != j)
+      loop->sources[j] = loop->sources[i];
+    j++;
+  }
+  loop->nsources = j;
+}
+
+static void
+_remove_source (event_loop_t *loop, event_source_t *source)
+{
+  _source_release (source);
+  source->removed = 1;
+  if (!loop->dispatching)
+    _compact_sources (loop);
+}
+
+int
+event_loop_add_fd (event_loop_t *loop, int fd, short events,
+    event_loop_fd_cb callback, void *user_data)
+{
+  event_source_t *source;
+
+  if (fd < 0 || _find_source (loop, fd) != NULL)
+    return -1;
+
+  source = _add_source (loop, SOURCE_FD, fd, events, user_data);
+  if (source == NULL)
+    return -1;
+  source->callback.fd = callback;
+
+  return 0;
+}
+
+int
+event_loop_set_fd_events (event_loop_t *loop, int fd, short events)
+{
+  event_source_t *source = _find_source (loop, fd);
+
+  if (source == NULL)
+    return -1;
+  source->events = events;
+
+  return 0;
+}
+
+void
+event_loop_remove_fd (event_loop_t *loop, int fd)
+{
+  event_source_t *source = _find_source (loop, fd);
+
+  if (source && source->type == SOURCE_FD)
+    _remove_source (loop, source);
+}
+
+int
+event_loop_add_timer (event_loop_t *loop, event_loop_timer_cb callback,
+    void *user_data)
+{
+  event_source_t *source;
+  int fd;
+
+  fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  source = _add_source (loop, SOURCE_TIMER, fd, POLLIN, user_data);
+  if (source == NULL) {
+    close (fd);
+    return -1;
+  }
+  source->callback.timer = callback;
+
+  return fd;
+}
+
+int
+event_loop_timer_set (event_loop_t *loop, int timer,
+    unsigned int delay_ms, unsigned int interval_ms)
+{
+  struct itimerspec spec;
+
+  memset (&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = delay_ms / 1000;
+  spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
+  spec.it_interval.tv_sec = interval_ms / 1000;
+  spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+
+  return timerfd_settime (timer, 0, &spec, NULL);
+}
+
+void
+event_loop_remove_timer (event_loop_t *loop, int timer)
+{
+  event_source_t *source = _find_source (loop, timer);
+
+  if (source && source->type == SOURCE_TIMER)
+    _remove_source (loop, source);
+}
+
+int
+event_loop_add_signal (event_loop_t *loop, int signum,
+    event_loop_signal_cb callback, void *user_data)
+{
+  event_source_t *source;
+  sigset_t mask;
+  int fd;
+
+  sigemptyset (&mask);
+  sigaddset (&mask, signum);
+  if (sigprocmask (SIG_BLOCK, &mask, NULL) != 0)
+    return -1;
+
+  fd = signalfd (-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0)
+    goto error;
+
+  source = _add_source (loop, SOURCE_SIGNAL, fd, POLLIN, user_data);
+  if (source == NULL) {
+    close (fd);
+    goto error;
+  }
+  source->signum = signum;
+  source->callback.signal = callback;
+
+  return 0;
+
+ error:
+  sigprocmask (SIG_UNBLOCK, &mask, NULL);
+  return -1;
+}
+
+static int
+_dispatch_source (event_loop_t *loop, event_source_t *source, short revents)
+{
+  if (source->type == SOURCE_TIMER) {
+    uint64_t expirations = 0;
+
+    /* A timer that was re-armed before we got to it will have nothing
+     * to read anymore, so it didn't really expire */
+    if (read (source->fd, &expirations, sizeof(expirations)) !=
+        sizeof(expirations))
+      return 0;
+    return source->callback.timer (loop, source->fd, expirations,
+        source->user_data);
+  } else if (source->type == SOURCE_SIGNAL) {
+    struct signalfd_siginfo info;
+    event_loop_signal_cb callback = source->callback.signal;
+    void *user_data = source->user_data;
+    int fd = source->fd;
+    int ret = 0;
+
+    /* The callback may add sources and move the array, so don't use
+     * @source once it got called */
+    while (ret == 0 && read (fd, &info, sizeof(info)) == sizeof(info))
+      ret = callback (loop, info.ssi_signo, user_data);
+    return ret;
+  }
+
+  return source->callback.fd (loop, source->fd, revents, source->user_data);
+}
+
+int
+event_loop_iterate (event_loop_t *loop, int timeout_ms)
+{
+  int nfds;
+  int dispatched = 0;
+  int i;
+
+  for (i = 0; i < loop->nsources; i++) {
+    loop->pollfds[i].fd = loop->sources[i].fd;
+    loop->pollfds[i].events = loop->sources[i].events;
+    loop->pollfds[i].revents = 0;
+  }
+  nfds = loop->nsources;
+
+  if (poll (loop->pollfds, nfds, timeout_ms) < 0)
+    return errno == EINTR ? 0 : -1;
+
+  loop->dispatching = 1;
+  for (i = 0; i < nfds; i++) {
+    event_source_t *source = &loop->sources[i];
+    short revents = loop->pollfds[i].revents;
+
+    if (revents == 0 || source->removed)
+      continue;
+
+    dispatched++;
+    if (_dispatch_source (loop, source, revents) != 0)
+      _remove_source (loop, &loop->sources[i]);
+  }
+  loop->dispatching = 0;
+  _compact_sources (loop);
+
+  return dispatched;
+}
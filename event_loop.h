@@ -0,0 +1,107 @@
+/*
+ * event_loop.h : poll() based event loop
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <stdint.h>
+
+typedef struct _event_loop event_loop_t;
+
+/**
+ * event_loop_fd_cb:
+ * @loop: The #event_loop_t dispatching the event
+ * @fd: The file descriptor that became ready
+ * @revents: The poll() events that were returned for @fd
+ * @user_data: The user data given when the source was added
+ *
+ * Called whenever @fd becomes ready for one of the requested events, or
+ * when an error or hangup is detected on it.
+ *
+ * Returns: 0 to keep watching @fd, -1 to remove it from the loop
+ */
+typedef int (*event_loop_fd_cb) (event_loop_t *loop, int fd, short revents,
+    void *user_data);
+
+/**
+ * event_loop_timer_cb:
+ * @loop: The #event_loop_t dispatching the event
+ * @timer: The timer id, as returned by event_loop_add_timer()
+ * @expirations: The number of times the timer expired since the last call
+ * @user_data: The user data given when the timer was added
+ *
+ * Returns: 0 to keep the timer, -1 to remove it from the loop
+ */
+typedef int (*event_loop_timer_cb) (event_loop_t *loop, int timer,
+    uint64_t expirations, void *user_data);
+
+/**
+ * event_loop_signal_cb:
+ * @loop: The #event_loop_t dispatching the event
+ * @signum: The signal that was received
+ * @user_data: The user data given when the signal was added
+ *
+ * Signals are delivered through a signalfd, so this is called from the
+ * loop like any other event and not from a signal handler context.
+ *
+ * Returns: 0 to keep watching the signal, -1 to remove it from the loop
+ */
+typedef int (*event_loop_signal_cb) (event_loop_t *loop, int signum,
+    void *user_data);
+
+event_loop_t *event_loop_new (void);
+void event_loop_free (event_loop_t *loop);
+
+/* Watch @fd for the poll() @events. Returns 0 on success, -1 on error */
+int event_loop_add_fd (event_loop_t *loop, int fd, short events,
+    event_loop_fd_cb callback, void *user_data);
+/* Change the events being watched on an already added @fd */
+int event_loop_set_fd_events (event_loop_t *loop, int fd, short events);
+/* Stop watching @fd. The fd itself is not closed */
+void event_loop_remove_fd (event_loop_t *loop, int fd);
+
+/*
+ * Create a disarmed monotonic timer. Returns the timer id (a timerfd owned by
+ * the loop) or -1 on error.
+ */
+int event_loop_add_timer (event_loop_t *loop, event_loop_timer_cb callback,
+    void *user_data);
+/*
+ * Arm @timer to expire after @delay_ms then every @interval_ms (0 for a
+ * one-shot timer). A @delay_ms of 0 disarms the timer.
+ */
+int event_loop_timer_set (event_loop_t *loop, int timer,
+    unsigned int delay_ms, unsigned int interval_ms);
+void event_loop_remove_timer (event_loop_t *loop, int timer);
+
+/*
+ * Block @signum and deliver it through the loop instead. Returns 0 on
+ * success, -1 on error.
+ */
+int event_loop_add_signal (event_loop_t *loop, int signum,
+    event_loop_signal_cb callback, void *user_data);
+
+/*
+ * Wait up to @timeout_ms (-1 for infinite) for events and dispatch them.
+ * Returns the number of sources that were dispatched or -1 on error.
+ */
+int event_loop_iterate (event_loop_t *loop, int timeout_ms);
+
+#endif /* __EVENT_LOOP_H__ */
@@ -16,6 +16,7 @@
 #include <time.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <math.h>
 #include <unistd.h>
@@ -27,6 +28,9 @@
 #include <cairo/cairo.h>
 
 #include "fbwhiptail_menu.h"
+#include "menu_file.h"
+#include "tag_index.h"
+#include "type_ahead.h"
 
 #ifdef GTKWHIPTAIL
 #include <gtk/gtk.h>
@@ -47,12 +51,81 @@
 #include <linux/kd.h>
 #include <linux/vt.h>
 #include <signal.h>
+#include <poll.h>
 
 #include "cairo_dri.h"
 #include "cairo_linuxfb.h"
+#include "event_loop.h"
+#include "evdev_input.h"
+#include "menu_stream.h"
+#include "gauge_parser.h"
+#include "gauge_shm.h"
+#include "gauge_pipe.h"
+#include "gauge_fdinfo.h"
 #endif
 
 #define VERSION_STRING "0.0.1"
+/* Same meaning as the ESCDELAY of ncurses, which can override it */
+#define DEFAULT_ESC_DELAY 25
+#define DEFAULT_MAX_FPS 30
+/* The typed prefix is forgotten after this long without a key press */
+#define TYPE_AHEAD_TIMEOUT 1000
+/* Neighbouring pages get rendered once input has been idle for this long,
+ * in steps short enough not to delay the next key press */
+#define PREFETCH_DELAY 100
+#define PREFETCH_BUDGET_US 4000
+/* A touch moving further than this scrolls the menu instead of choosing */
+#define DRAG_THRESHOLD 10
+
+/* Modes showing a list of tag/item pairs */
+#define IS_LIST_MODE(mode) ((mode) == MODE_MENU || \
+      (mode) == MODE_CHECKLIST || (mode) == MODE_RADIOLIST)
+
+/* Unchecked and checked images of --checklist and --radiolist items */
+static cairo_surface_t *checkbox_images[2];
+
+/* Only one item is formatted at a time, the "tag - item" label grows to fit
+ * the longest one */
+static char *item_label;
+static size_t item_label_size;
+
+/* Whiptail's output, with the checked tags quoted on one line or one per
+ * line with --separate-output. Built in memory so it goes out in a single
+ * write, however many items are checked */
+static void write_checked_tags(whiptail_args *args)
+{
+  size_t len = 0, allocated = 0;
+  char *buffer = NULL;
+  int i;
+
+  for (i = bitset_next (&args->checked, 0); i >= 0;
+       i = bitset_next (&args->checked, i + 1)) {
+    size_t needed = len + strlen (args->items[i].tag) + 4;
+
+    if (needed > allocated) {
+      char *new_buffer;
+
+      allocated = allocated ? allocated * 2 : 4096;
+      while (allocated < needed)
+        allocated *= 2;
+      new_buffer = realloc (buffer, allocated);
+      if (new_buffer == NULL)
+        break;
+      buffer = new_buffer;
+    }
+    if (args->mode == MODE_RADIOLIST)
+      len += sprintf (buffer + len, "%s", args->items[i].tag);
+    else if (args->separate_output)
+      len += sprintf (buffer + len, "%s\n", args->items[i].tag);
+    else
+      len += sprintf (buffer + len, "%s\"%s\"", len ? " " : "",
+          args->items[i].tag);
+  }
+
+  if (len > 0 && write (args->output_fd, buffer, len) < 0)
+    perror ("write");
+  free (buffer);
+}
 
 #ifdef GTKWHIPTAIL
 
@@ -75,6 +148,14 @@ static gint key_event(GtkWidget *widget, GdkEventKey *event, gpointer data)
     input = CAIRO_MENU_INPUT_LEFT;
   else if (event->keyval == GDK_Right)
     input = CAIRO_MENU_INPUT_RIGHT;
+  else if (event->keyval == GDK_Page_Up)
+    input = CAIRO_MENU_INPUT_PAGE_UP;
+  else if (event->keyval == GDK_Page_Down)
+    input = CAIRO_MENU_INPUT_PAGE_DOWN;
+  else if (event->keyval == GDK_Home)
+    input = CAIRO_MENU_INPUT_HOME;
+  else if (event->keyval == GDK_End)
+    input = CAIRO_MENU_INPUT_END;
   else if (event->keyval == GDK_Escape)
     gtk_main_quit ();
   else if (event->keyval == GDK_KP_Enter || event->keyval == GDK_Return) {
@@ -86,7 +167,7 @@ static gint key_event(GtkWidget *widget, GdkEventKey *event, gpointer data)
   if (menu->gauge) {
     static int gauge_value = 0;
     standard_menu_update_gauge (menu, gauge_value++);
-  } else {
+  } else if (!standard_menu_scroll_text (menu, input)) {
     cairo_menu_handle_input (menu->menu, input, &bbox);
   }
   gtk_widget_queue_draw_area (widget, 0, 0, menu->width, menu->height);
@@ -110,95 +191,718 @@ draw (GtkWidget *widget, GdkEventExpose *eev, gpointer data)
 
 #else
 
-static volatile sig_atomic_t cancel = 0;
+typedef enum {
+  ESCAPE_NONE = 0,
+  ESCAPE_ESC,
+  ESCAPE_CSI,
+  ESCAPE_CSI_MODIFIER,
+  ESCAPE_SS3,
+  ESCAPE_CONSOLE_FKEY,
+} escape_state;
+
+typedef struct {
+  const char *tag;
+  int item;
+  int percent;
+  int changed;
+  char status[32];
+} mixed_gauge_bar;
+
+typedef struct {
+  Menu *menu;
+  whiptail_args *args;
+  event_loop_t *loop;
+  cairo_dri_t *dri;
+  evdev_input_t *evdev;
+  escape_state escape;
+  int escape_param;
+  int escape_timer;
+  gauge_parser_t gauge;
+  /* Latest gauge values, applied with the next frame if they changed */
+  int gauge_percent;
+  int gauge_percent_changed;
+  char *gauge_text;
+  int gauge_text_changed;
+  gauge_shm_t *shm;
+  gauge_pipe_t *pipe;
+  gauge_fdinfo_t *fdinfo;
+  /* --stream-items, args->items has room for allocated_items */
+  menu_stream_t *stream;
+  int allocated_items;
+  /* --mixedgauge bars, the overall progress is the last one */
+  mixed_gauge_bar *bars;
+  int nbars;
+  tag_index_t *tags;
+  type_ahead_t *type_ahead;
+  int type_ahead_timer;
+  int redraw;
+  int frame_timer;
+  int prefetch_timer;
+  int frame_throttled;
+  int flips_pending;
+  /* Where the first screen is drawn, pointers are mapped to it */
+  int screen_x;
+  int screen_y;
+  int pointer_pressed;
+  int pointer_dragging;
+  int press_x;
+  int press_y;
+  int press_item;
+  int press_scroll_x;
+  int press_scroll_y;
+  /* Where the mouse started, or last selected something by hovering it */
+  int hover_anchored;
+  int hover_x;
+  int hover_y;
+  int return_value;
+} whiptail_context;
+
+static int cancel = 0;
+
+static void report_result(whiptail_context *ctx)
+{
+  if (ctx->args->mode == MODE_MENU)
+    fprintf (stderr, "%s", ctx->args->items[ctx->menu->menu->selection].tag);
+  else if (ctx->args->mode == MODE_CHECKLIST ||
+      ctx->args->mode == MODE_RADIOLIST)
+    write_checked_tags (ctx->args);
+  else if (ctx->args->mode == MODE_YESNO) {
+    if (ctx->menu->menu->selection != 0)
+      ctx->return_value = 1;
+  }
+}
 
-void signal_handler(int signum)
+/* Only the checkbox of an item changes, so only its pixels get drawn */
+static void redraw_checkbox(whiptail_context *ctx, int index)
 {
-  cancel = 1;
+  CairoMenuItem *item = cairo_menu_get_item (ctx->menu->menu, index);
+  CairoMenuRectangle area;
+
+  area.width = cairo_utils_get_surface_width (checkbox_images[0]);
+  area.height = cairo_utils_get_surface_height (checkbox_images[0]);
+  area.x = item->width - item->ipad_x - area.width;
+  area.y = item->ipad_y;
+  cairo_menu_redraw_item_area (ctx->menu->menu, index, &area);
+  ctx->redraw = 1;
 }
 
-static int handle_arrow_input(Menu *menu, short code)
+static void toggle_selection(whiptail_context *ctx)
 {
-    CairoMenuInput input;
-    CairoMenuRectangle bbox = {0, 0, 0, 0};
+  whiptail_args *args = ctx->args;
+  int index = ctx->menu->menu->selection;
+  int previous;
+
+  if (ctx->menu->menu->nitems == 0)
+    return;
+
+  if (args->mode == MODE_CHECKLIST) {
+    bitset_set (&args->checked, index, !bitset_get (&args->checked, index));
+    redraw_checkbox (ctx, index);
+  } else if (args->mode == MODE_RADIOLIST) {
+    previous = bitset_next (&args->checked, 0);
+    if (previous == index)
+      return;
+    if (previous >= 0) {
+      bitset_set (&args->checked, previous, 0);
+      redraw_checkbox (ctx, previous);
+    }
+    bitset_set (&args->checked, index, 1);
+    redraw_checkbox (ctx, index);
+  }
+}
 
-    if (code == 0x41)
-        input = CAIRO_MENU_INPUT_UP;
-    else if (code == 0x42)
-        input = CAIRO_MENU_INPUT_DOWN;
-    else if (code == 0x43)
-        input = CAIRO_MENU_INPUT_RIGHT;
-    else if (code == 0x44)
-        input = CAIRO_MENU_INPUT_LEFT;
-    else
-      return 0;
+/* Keys from every input backend end up here, as KEY_* codes */
+static void handle_key(whiptail_context *ctx, int key)
+{
+  CairoMenuInput input;
 
-    cairo_menu_handle_input (menu->menu, input, &bbox);
-    return (bbox.width * bbox.height) != 0;
+  switch (key) {
+    case KEY_SPACE:
+      toggle_selection (ctx);
+      return;
+    case KEY_ESC:
+      cancel = 1;
+      return;
+    case KEY_ENTER:
+    case KEY_KPENTER:
+      /* Streamed menus can still be empty */
+      if (ctx->menu->gauge || ctx->menu->menu->nitems == 0)
+        return;
+      cancel = 1;
+      report_result (ctx);
+      return;
+    case KEY_UP:
+      input = CAIRO_MENU_INPUT_UP;
+      break;
+    case KEY_DOWN:
+      input = CAIRO_MENU_INPUT_DOWN;
+      break;
+    case KEY_RIGHT:
+      input = CAIRO_MENU_INPUT_RIGHT;
+      break;
+    case KEY_LEFT:
+      input = CAIRO_MENU_INPUT_LEFT;
+      break;
+    case KEY_PAGEUP:
+      input = CAIRO_MENU_INPUT_PAGE_UP;
+      break;
+    case KEY_PAGEDOWN:
+      input = CAIRO_MENU_INPUT_PAGE_DOWN;
+      break;
+    case KEY_HOME:
+      input = CAIRO_MENU_INPUT_HOME;
+      break;
+    case KEY_END:
+      input = CAIRO_MENU_INPUT_END;
+      break;
+    default:
+      return;
+  }
+
+  /* Textboxes scroll their text, the button never moves */
+  if (ctx->menu->text.file) {
+    if (standard_menu_scroll_text (ctx->menu, input))
+      ctx->redraw = 1;
+    return;
+  }
+
+  /* Moving around starts a new search */
+  if (ctx->type_ahead)
+    type_ahead_reset (ctx->type_ahead);
+
+  /* Only update the model, the frame gets drawn once all the pending input
+   * has been handled */
+  cairo_menu_move_selection (ctx->menu->menu, input);
+  if (ctx->menu->menu->dirty)
+    ctx->redraw = 1;
 }
 
-static int handle_input(Menu *menu)
+/* Search what is shown first on each item */
+static const char *menu_item_key(int index, void *user_data)
 {
-  static int escape = 0;
-  static char input_data[10] = {0};
-  static char input_size = 0;
-  char c;
-  int result = 0;
+  whiptail_args *args = user_data;
 
-  switch (c = getchar ()) {
-    case 0x1B: // Escape character
-      if (escape == 0)
-        escape = 1;
-      else
-        cancel = 1; // Double Escape
+  return args->notags ? args->items[index].item : args->items[index].tag;
+}
+
+/* Printable characters jump to the item whose tag starts with them */
+static void handle_char(whiptail_context *ctx, char c)
+{
+  int idx;
+
+  if (ctx->type_ahead == NULL)
+    return;
+
+  event_loop_timer_set (ctx->loop, ctx->type_ahead_timer,
+      TYPE_AHEAD_TIMEOUT, 0);
+  idx = type_ahead_feed (ctx->type_ahead, c, ctx->menu->menu->selection);
+  if (idx >= 0)
+    cairo_menu_select (ctx->menu->menu, idx);
+  if (ctx->menu->menu->dirty)
+    ctx->redraw = 1;
+}
+
+static int type_ahead_timeout(event_loop_t *loop, int timer,
+    uint64_t expirations, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  type_ahead_reset (ctx->type_ahead);
+  return 0;
+}
+
+/* Map the final byte (and numeric parameter) of a CSI or SS3 sequence */
+static int escape_sequence_to_key(char final, int param)
+{
+  switch (final) {
+    case 'A':
+      return KEY_UP;
+    case 'B':
+      return KEY_DOWN;
+    case 'C':
+      return KEY_RIGHT;
+    case 'D':
+      return KEY_LEFT;
+    case 'H':
+      return KEY_HOME;
+    case 'F':
+      return KEY_END;
+    case '~':
+      /* VT220 style editing keys, with the key in the parameter */
+      switch (param) {
+        case 1:
+        case 7:
+          return KEY_HOME;
+        case 4:
+        case 8:
+          return KEY_END;
+        case 5:
+          return KEY_PAGEUP;
+        case 6:
+          return KEY_PAGEDOWN;
+        default:
+          return 0;
+      }
+    default:
+      return 0;
+  }
+}
+
+static void handle_input(whiptail_context *ctx, char c)
+{
+  int key;
+
+  switch (ctx->escape) {
+    case ESCAPE_NONE:
       break;
-    case 0xA: // Enter
-      if (escape == 0) {
-        if (menu->gauge) {
-          if (input_size > 0 && input_size < sizeof(input_data)) {
-            int percent;
-            char *endp;
-
-            input_data[input_size] = 0;
-            percent = strtoul (input_data, &endp, 10);
-            if (*endp == '\0') {
-              standard_menu_update_gauge (menu, atoi (input_data));
-              result = 1;
-            }
-          }
-          input_size = 0;
-        } else {
-          cancel = 1;
-          result = 2;
-        }
+    case ESCAPE_ESC:
+      if (c == '[') {
+        ctx->escape = ESCAPE_CSI;
+        ctx->escape_param = 0;
+        return;
+      } else if (c == 'O') {
+        ctx->escape = ESCAPE_SS3;
+        return;
       }
-      escape = 0;
+      /* Not a sequence, so that was a lone Escape */
+      ctx->escape = ESCAPE_NONE;
+      event_loop_timer_set (ctx->loop, ctx->escape_timer, 0, 0);
+      handle_key (ctx, KEY_ESC);
       break;
-    case 0x41: // Arrow keys
-    case 0x42:
-    case 0x43:
-    case 0x44:
-      if (escape == 2) {
-        handle_arrow_input (menu, c);
-        result = 1;
+    case ESCAPE_CSI:
+      if (c >= '0' && c <= '9') {
+        ctx->escape_param = ctx->escape_param * 10 + c - '0';
+        return;
+      } else if (c == ';') {
+        /* Modifiers are ignored, only keep the first parameter */
+        ctx->escape = ESCAPE_CSI_MODIFIER;
+        return;
+      } else if (c == '[' && ctx->escape_param == 0) {
+        /* The Linux console sends ESC [ [ A to E for F1 to F5 */
+        ctx->escape = ESCAPE_CONSOLE_FKEY;
+        return;
       }
-    default:
-      if (escape == 0) {
-        if (input_size < sizeof(input_data) - 1)
-            input_data[input_size++] = c;
+      /* fallthrough */
+    case ESCAPE_CSI_MODIFIER:
+    case ESCAPE_SS3:
+      /* Wait for the final byte of the sequence */
+      if ((c >= '0' && c <= '9') || c == ';')
+        return;
+      ctx->escape = ESCAPE_NONE;
+      event_loop_timer_set (ctx->loop, ctx->escape_timer, 0, 0);
+      key = escape_sequence_to_key (c, ctx->escape_param);
+      if (key)
+        handle_key (ctx, key);
+      return;
+    case ESCAPE_CONSOLE_FKEY:
+      /* Function keys do nothing, drop the final byte */
+      ctx->escape = ESCAPE_NONE;
+      event_loop_timer_set (ctx->loop, ctx->escape_timer, 0, 0);
+      return;
+  }
+
+  switch (c) {
+    case 0x1B: // Escape character
+      /* Could be the start of a sequence, it's only an Escape key if nothing
+       * follows it within the escape delay */
+      if (ctx->args->esc_delay > 0) {
+        ctx->escape = ESCAPE_ESC;
+        if (event_loop_timer_set (ctx->loop, ctx->escape_timer,
+                ctx->args->esc_delay, 0) == 0)
+          break;
+        ctx->escape = ESCAPE_NONE;
       }
-      if (escape == 1) {
-        escape = 2;
-      } else {
-        escape = 0;
+      /* A zero delay would disarm the timer, the Escape is reported now */
+      handle_key (ctx, KEY_ESC);
+      break;
+    case 0xA: // Enter
+      handle_key (ctx, KEY_ENTER);
+      break;
+    case ' ':
+      handle_key (ctx, KEY_SPACE);
+      break;
+    default:
+      if (c > ' ' && c < 0x7F)
+        handle_char (ctx, c);
+      break;
+  }
+}
+
+static int escape_timeout(event_loop_t *loop, int timer, uint64_t expirations,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  /* Nothing followed the Escape character, or the sequence was never
+   * completed */
+  if (ctx->escape == ESCAPE_ESC)
+    handle_key (ctx, KEY_ESC);
+  ctx->escape = ESCAPE_NONE;
+
+  return 0;
+}
+
+/* Same status codes as the --mixedgauge of dialog */
+static const char *mixed_gauge_status[] = {
+  "Succeeded", "Failed", "Passed", "Completed", "Checked", "Done",
+  "Skipped", "In Progress", "", "N/A",
+};
+
+static void set_mixed_gauge_status(whiptail_context *ctx, mixed_gauge_bar *bar,
+    const char *status)
+{
+  snprintf (bar->status, sizeof(bar->status), "%s", status);
+  bar->changed = 1;
+  ctx->redraw = 1;
+}
+
+/* Bars only get repainted once per frame, no matter how many updates they
+ * received in the meantime */
+static void apply_mixed_gauge(whiptail_context *ctx)
+{
+  char label[128];
+  const char *status;
+  char *endp;
+  long value;
+  int i;
+
+  for (i = 0; i < ctx->nbars; i++) {
+    mixed_gauge_bar *bar = &ctx->bars[i];
+
+    if (!bar->changed)
+      continue;
+    bar->changed = 0;
+
+    status = bar->status;
+    value = strtol (bar->status, &endp, 10);
+    if (endp != bar->status && *endp == 0) {
+      if (bar->status[0] == '-') {
+        /* Negative values are a percentage */
+        bar->percent = -value;
+        status = NULL;
+      } else if (value < (long) (sizeof(mixed_gauge_status) / sizeof(char *))) {
+        status = mixed_gauge_status[value];
+        if (value == 0 || (value >= 2 && value <= 5))
+          bar->percent = 100;
       }
+    }
+    if (status)
+      snprintf (label, sizeof(label), "%s: %s", bar->tag, status);
+    else
+      snprintf (label, sizeof(label), "%s: %d%%", bar->tag, bar->percent);
+    standard_menu_update_gauge_item (ctx->menu, bar->item, bar->percent,
+        label);
+  }
+}
+
+static void mixed_gauge_item(const char *tag, const char *status,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  int i;
+
+  i = tag_index_lookup (ctx->tags, tag);
+  if (i >= 0)
+    set_mixed_gauge_status (ctx, &ctx->bars[i], status);
+}
+
+/* Record new gauge values, -1 or NULL for the ones that didn't change.
+ * Relaying out the text and painting the bars waits for the next frame */
+static void update_gauge(whiptail_context *ctx, int percent, const char *text)
+{
+  if (text && (ctx->gauge_text == NULL || strcmp (ctx->gauge_text, text) != 0)) {
+    char *copy = strdup (text);
+
+    if (copy) {
+      free (ctx->gauge_text);
+      ctx->gauge_text = copy;
+      ctx->gauge_text_changed = 1;
+      ctx->redraw = 1;
+    }
+  }
+  if (percent >= 0 && percent != ctx->gauge_percent) {
+    ctx->gauge_percent = percent;
+    ctx->gauge_percent_changed = 1;
+    ctx->redraw = 1;
+  }
+}
+
+static void apply_gauge(whiptail_context *ctx)
+{
+  if (ctx->gauge_text_changed) {
+    ctx->gauge_text_changed = 0;
+    standard_menu_set_text (ctx->menu, ctx->gauge_text);
+  }
+  if (ctx->gauge_percent_changed && ctx->bars) {
+    char status[8];
+
+    ctx->gauge_percent_changed = 0;
+    snprintf (status, sizeof(status), "-%d", ctx->gauge_percent);
+    set_mixed_gauge_status (ctx, &ctx->bars[ctx->nbars - 1], status);
+  } else if (ctx->gauge_percent_changed) {
+    ctx->gauge_percent_changed = 0;
+    standard_menu_update_gauge (ctx->menu, ctx->gauge_percent);
+  }
+}
+
+static int stdin_ready(event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  char buffer[4096];
+  int len, i;
+
+  /* stdin is non blocking, read everything that is pending so that a burst
+   * of input (key repeats, gauge updates) results in a single frame */
+  while (!cancel) {
+    len = read (fd, buffer, sizeof(buffer));
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0 && errno == EAGAIN)
       break;
-    case EOF:
+    /* With keys coming from evdev, stdin reaching its end (/dev/null, a
+     * closed pipe) isn't a cancel */
+    if (len <= 0 && ctx->evdev && !ctx->menu->gauge)
+      return -1;
+    if (len <= 0) {
       cancel = 1;
       break;
+    }
+
+    /* In gauge mode, stdin is the progress being piped to us */
+    if (ctx->menu->gauge) {
+      gauge_parser_feed (&ctx->gauge, buffer, len);
+      continue;
+    }
+
+    /* Keys come from evdev, so only drain the terminal so nothing leaks
+     * into the shell once we exit */
+    if (ctx->evdev)
+      continue;
+
+    for (i = 0; i < len && !cancel; i++)
+      handle_input (ctx, buffer[i]);
+  }
+
+  /* Only the latest values matter */
+  update_gauge (ctx, ctx->gauge.percent,
+      ctx->gauge.text_changed ? ctx->gauge.text : NULL);
+  ctx->gauge.percent = -1;
+  ctx->gauge.text_changed = 0;
+
+  return cancel ? -1 : 0;
+}
+
+static void pipe_progress(uint64_t bytes, int status, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  if (status < 0) {
+    ctx->return_value = 1;
+    cancel = 1;
+    return;
+  }
+
+  if (ctx->args->gauge_size > 0)
+    update_gauge (ctx, bytes * 100 / ctx->args->gauge_size, NULL);
+  if (status > 0)
+    cancel = 1;
+}
+
+static int fdinfo_sample(event_loop_t *loop, int timer, uint64_t expirations,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  long long pos = gauge_fdinfo_sample (ctx->fdinfo);
+
+  /* The process is done with the file */
+  if (pos < 0) {
+    cancel = 1;
+    return -1;
+  }
+
+  if (ctx->args->gauge_size > 0) {
+    update_gauge (ctx, pos * 100 / ctx->args->gauge_size, NULL);
+    /* Nothing tells us when a file is complete other than its size */
+    if (ctx->args->gauge_file && pos >= ctx->args->gauge_size)
+      cancel = 1;
+  }
+
+  return 0;
+}
+
+static int shm_sample(event_loop_t *loop, int timer, uint64_t expirations,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  const char *text;
+  int percent, flags;
+
+  if (gauge_shm_sample (ctx->shm, &percent, &flags, &text) == 0)
+    return 0;
+
+  if (percent < 0)
+    percent = 0;
+  update_gauge (ctx, percent, text);
+  if (flags & GAUGE_SHM_FLAG_DONE)
+    cancel = 1;
+
+  return 0;
+}
+
+/* US layout, for the keys that can be typed into the type-ahead search */
+static const char evdev_keymap[] =
+  "\0\0" "1234567890-=" "\0\0" "qwertyuiop[]" "\0\0" "asdfghjkl;'`" "\0\\"
+  "zxcvbnm,./";
+
+static void evdev_key(int code, int value, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  /* Key presses and autorepeats, ignore releases */
+  if (value == 0 || cancel)
+    return;
+
+  if (code < (int) sizeof(evdev_keymap) - 1 && evdev_keymap[code])
+    handle_char (ctx, evdev_keymap[code]);
+  else
+    handle_key (ctx, code);
+}
+
+/* Touching an item selects it, and lifting the finger from it chooses it,
+ * or toggles it in a checklist, unless it moved enough to drag the menu
+ * around. Mice click with the left button, and select what they hover only
+ * once moved on purpose since no cursor is drawn. */
+static void evdev_pointer(int x, int y, int pressed, int relative,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  CairoMenu *cmenu = ctx->menu->menu;
+  int item;
+
+  if (cancel || ctx->menu->gauge)
+    return;
+
+  x -= ctx->screen_x;
+  y -= ctx->screen_y;
+  if (standard_menu_to_menu_coords (ctx->menu, &x, &y) != 0)
+    return;
+
+  if (pressed && !ctx->pointer_pressed) {
+    ctx->pointer_pressed = 1;
+    ctx->pointer_dragging = 0;
+    ctx->press_x = x;
+    ctx->press_y = y;
+    ctx->press_item = cairo_menu_get_item_at (cmenu, x, y);
+    if (ctx->press_item >= 0)
+      cairo_menu_select (cmenu, ctx->press_item);
+    if (ctx->type_ahead)
+      type_ahead_reset (ctx->type_ahead);
+    cairo_menu_get_scroll (cmenu, &ctx->press_scroll_x, &ctx->press_scroll_y);
+  } else if (pressed) {
+    if (abs (x - ctx->press_x) + abs (y - ctx->press_y) > DRAG_THRESHOLD)
+      ctx->pointer_dragging = 1;
+    if (ctx->pointer_dragging)
+      cairo_menu_scroll_to (cmenu, ctx->press_scroll_x - (x - ctx->press_x),
+          ctx->press_scroll_y - (y - ctx->press_y));
+  } else if (ctx->pointer_pressed) {
+    ctx->pointer_pressed = 0;
+    if (!ctx->pointer_dragging && ctx->press_item >= 0 &&
+        cmenu->selection == ctx->press_item &&
+        cairo_menu_get_item_at (cmenu, x, y) == ctx->press_item)
+      handle_key (ctx, (ctx->args->mode == MODE_CHECKLIST ||
+              ctx->args->mode == MODE_RADIOLIST) ? KEY_SPACE : KEY_ENTER);
+  } else if (relative && !ctx->hover_anchored) {
+    ctx->hover_anchored = 1;
+    ctx->hover_x = x;
+    ctx->hover_y = y;
+  } else if (relative &&
+      abs (x - ctx->hover_x) + abs (y - ctx->hover_y) > DRAG_THRESHOLD) {
+    ctx->hover_x = x;
+    ctx->hover_y = y;
+    item = cairo_menu_get_item_at (cmenu, x, y);
+    if (item >= 0)
+      cairo_menu_select (cmenu, item);
+  }
+
+  if (cmenu->dirty)
+    ctx->redraw = 1;
+}
+
+/* Items streamed in are appended without moving the selection, only the
+ * ones that end up visible get drawn */
+static void stream_item(const char *tag, const char *item, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  whiptail_args *args = ctx->args;
+
+  if (tag == NULL)
+    return;
+
+  /* Streamed items start unchecked */
+  if ((args->mode == MODE_CHECKLIST || args->mode == MODE_RADIOLIST) &&
+      bitset_resize (&args->checked, args->num_items + 1) != 0)
+    return;
+
+  if (args->num_items == ctx->allocated_items) {
+    int allocated = ctx->allocated_items ? ctx->allocated_items * 2 : 64;
+    whiptail_menu_item *items;
+
+    items = realloc (args->items, allocated * sizeof(whiptail_menu_item));
+    if (items == NULL)
+      return;
+    args->items = items;
+    ctx->allocated_items = allocated;
   }
+  args->items[args->num_items].tag = (char *) tag;
+  args->items[args->num_items].item = (char *) item;
+  tag_index_add (ctx->tags, tag, args->num_items);
+  args->num_items++;
+
+  cairo_menu_set_item_count (ctx->menu->menu, args->num_items);
+  if (ctx->type_ahead)
+    type_ahead_set_count (ctx->type_ahead, args->num_items);
+  if (ctx->menu->menu->dirty)
+    ctx->redraw = 1;
+}
+
+static int prefetch_timeout(event_loop_t *loop, int timer,
+    uint64_t expirations, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  /* Give the loop a chance to handle input between steps */
+  if (cairo_menu_prefetch (ctx->menu->menu, PREFETCH_BUDGET_US))
+    event_loop_timer_set (loop, timer, 1, 0);
+  return 0;
+}
+
+static int frame_timeout(event_loop_t *loop, int timer, uint64_t expirations,
+    void *user_data)
+{
+  whiptail_context *ctx = user_data;
+
+  ctx->frame_throttled = 0;
+  return 0;
+}
+
+static int dri_ready(event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  whiptail_context *ctx = user_data;
+  int flips = cairo_dri_handle_events (ctx->dri);
+
+  if (flips < 0)
+    return -1;
+  ctx->flips_pending -= flips;
+  if (ctx->flips_pending < 0)
+    ctx->flips_pending = 0;
 
-  return result;
+  return 0;
+}
+
+static int signal_received(event_loop_t *loop, int signum, void *user_data)
+{
+  cancel = 1;
+  return 0;
 }
 
 #endif
@@ -221,13 +925,11 @@ void print_usage (int exit_code)
   printf ("\t--passwordbox <text> <height> <width> [init] \n");
   printf ("\t\tThis option is not supported\n");
   printf ("\t--textbox <file> <height> <width>\n");
-  printf ("\t\tThis option is not yet supported\n");
   printf ("\t--menu <text> <height> <width> <listheight> [tag item] ...\n");
   printf ("\t--checklist <text> <height> <width> <listheight> [tag item status]...\n");
-  printf ("\t\tThis option is not supported\n");
   printf ("\t--radiolist <text> <height> <width> <listheight> [tag item status]...\n");
-  printf ("\t\tThis option is not supported\n");
   printf ("\t--gauge <text> <height> <width> <percent>\n");
+  printf ("\t--mixedgauge <text> <height> <width> <percent> [tag status]...\n");
   printf ("Options: (depend on box-option)\n");
   printf ("\t--clear\t\t\t\tclear screen on exit\n");
   printf ("\t--defaultno\t\t\tdefault no button\n");
@@ -242,7 +944,6 @@ void print_usage (int exit_code)
   printf ("\t--noitem\t\t\tdon't display items\n");
   printf ("\t--notags\t\t\tdon't display tags\n");
   printf ("\t--separate-output\t\toutput one line at a time\n");
-  printf ("\t\tThis option is not supported\n");
   printf ("\t--output-fd <fd>\t\toutput to fd, not stdout\n");
   printf ("\t--title <title>\t\t\tdisplay title\n");
   printf ("\t--backtitle <backtitle>\t\tdisplay backtitle\n");
@@ -256,6 +957,19 @@ void print_usage (int exit_code)
   printf ("\t--background-gradient <start red> <start green> <start blue> <end red> <end green> <end blue>\n");
   printf ("\t\t\t\t\tGenerate a linear gradient background from left to right\n");
   printf ("\t--text-size <size>\t\tSet the text font size\n");
+  printf ("\t--esc-delay <ms>\t\tTime to wait for an escape sequence after Escape\n");
+  printf ("\t--gauge-pipe <total bytes>\tCopy stdin to stdout, showing how much was copied\n");
+  printf ("\t--gauge-pid <pid> <fd>\t\tShow the position of a process in the file it has open\n");
+  printf ("\t--gauge-file <file> <size>\tShow the size of a file being written\n");
+  printf ("\t--gauge-shm <file>\t\tRead the gauge progress from a shared memory record\n");
+  printf ("\t--max-fps <fps>\t\t\tLimit how often the screen gets redrawn, up to 1000, 0 for no limit\n");
+  printf ("\t--evdev\t\t\t\tRead keys, mice and touchscreens from /dev/input\n");
+  printf ("\t\t\t\t\tinstead of the terminal\n");
+  printf ("\t--menu-file <file>\t\tRead tag/item pairs from a file, '-' for stdin\n");
+  printf ("\t--items-fd <fd>\t\t\tRead tag/item pairs from a file descriptor\n");
+  printf ("\t\t\t\t\tOne field per line, or NUL separated\n");
+  printf ("\t--stream-items <fd>\t\tKeep adding tag/item pairs read from a file\n");
+  printf ("\t\t\t\t\tdescriptor while the menu is shown\n");
 
   exit (exit_code);
 }
@@ -284,6 +998,12 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
   args->gauge_rgb[4] = 0.1;
   args->gauge_rgb[5] = 0.1;
   args->text_size = 20;
+  args->esc_delay = DEFAULT_ESC_DELAY;
+  args->max_fps = DEFAULT_MAX_FPS;
+  args->items_fd = -1;
+  args->stream_fd = -1;
+  if (getenv ("ESCDELAY"))
+    args->esc_delay = atoi (getenv ("ESCDELAY"));
 
   for (i = 1; i < argc; i++) {
     if (end_of_args == 0 && strcmp (argv[i], "-h") == 0) {
@@ -336,6 +1056,22 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
           args->gauge_percent = 100;
         i += 4;
         args->mode = MODE_GAUGE;
+      } else if (strcmp (argv[i], "--mixedgauge") == 0) {
+        if (args->mode != MODE_NONE)
+          goto mode_already_set;
+        if (i + 4 >= argc)
+          goto missing_value;
+        args->text = argv[i+1];
+        args->height = atoi (argv[i+2]);
+        args->width = atoi (argv[i+3]);
+        args->gauge_percent = atoi (argv[i+4]);
+        if (args->gauge_percent < 0)
+          args->gauge_percent = 0;
+        if (args->gauge_percent > 100)
+          args->gauge_percent = 100;
+        i += 4;
+        args->mode = MODE_MIXEDGAUGE;
+        args->items = malloc (sizeof(whiptail_menu_item) * ((argc - i) / 2 + 1));
       } else if (strcmp (argv[i], "--menu") == 0) {
         if (args->mode != MODE_NONE)
           goto mode_already_set;
@@ -348,6 +1084,26 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
         i += 4;
         args->mode = MODE_MENU;
         args->items = malloc (sizeof(whiptail_menu_item) * (argc - i) / 2);
+      } else if (strcmp (argv[i], "--checklist") == 0 ||
+          strcmp (argv[i], "--radiolist") == 0) {
+        if (args->mode != MODE_NONE)
+          goto mode_already_set;
+        if (i + 4 >= argc)
+          goto missing_value;
+        if (strcmp (argv[i], "--checklist") == 0)
+          args->mode = MODE_CHECKLIST;
+        else
+          args->mode = MODE_RADIOLIST;
+        args->text = argv[i+1];
+        args->height = atoi (argv[i+2]);
+        args->width = atoi (argv[i+3]);
+        args->menu_height = atoi (argv[i+4]);
+        i += 4;
+        args->items = malloc (sizeof(whiptail_menu_item) * ((argc - i) / 3 + 1));
+        if (bitset_init (&args->checked, (argc - i) / 3 + 1) != 0)
+          goto error;
+      } else if (strcmp (argv[i], "--separate-output") == 0) {
+        args->separate_output = 1;
       } else if (strcmp (argv[i], "--yesno") == 0) {
         if (args->mode != MODE_NONE)
           goto mode_already_set;
@@ -368,6 +1124,16 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
         args->width = atoi (argv[i+3]);
         i += 3;
         args->mode = MODE_MSGBOX;
+      } else if (strcmp (argv[i], "--textbox") == 0) {
+        if (args->mode != MODE_NONE)
+          goto mode_already_set;
+        if (i + 3 >= argc)
+          goto missing_value;
+        args->textbox = argv[i+1];
+        args->height = atoi (argv[i+2]);
+        args->width = atoi (argv[i+3]);
+        i += 3;
+        args->mode = MODE_TEXTBOX;
       }else if (strcmp (argv[i], "--") == 0) {
         end_of_args = 1;
       } else if (strcmp (argv[i], "--yes-button") == 0) {
@@ -391,7 +1157,6 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
           strcmp (argv[i], "--defaultno") == 0 ||
           strcmp (argv[i], "--nocancel") == 0 ||
           strcmp (argv[i], "--scrolltext") == 0 ||
-          strcmp (argv[i], "--separate-output") == 0 ||
           strcmp (argv[i], "--version") == 0) {
         // Ignore unsupported whiptail arguments
       } else if (strcmp (argv[i], "--background-png") == 0) {
@@ -423,6 +1188,64 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
         args->gauge_rgb[4] = (float) atoi (argv[i+5]) / 256;
         args->gauge_rgb[5] = (float) atoi (argv[i+6]) / 256;
         i += 6;
+      } else if (strcmp (argv[i], "--esc-delay") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->esc_delay = atoi (argv[++i]);
+      } else if (strcmp (argv[i], "--gauge-pipe") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->gauge_pipe = 1;
+        args->gauge_size = strtoull (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "--gauge-pid") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 2 >= argc)
+          goto missing_value;
+        args->gauge_pid = atoi (argv[i+1]);
+        args->gauge_pid_fd = atoi (argv[i+2]);
+        i += 2;
+      } else if (strcmp (argv[i], "--gauge-file") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 2 >= argc)
+          goto missing_value;
+        args->gauge_file = argv[i+1];
+        args->gauge_size = strtoull (argv[i+2], NULL, 10);
+        i += 2;
+      } else if (strcmp (argv[i], "--gauge-shm") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->gauge_shm = argv[++i];
+      } else if (strcmp (argv[i], "--max-fps") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->max_fps = atoi (argv[++i]);
+        /* Frames are timed in milliseconds, a 0ms timer would never fire */
+        if (args->max_fps < 0 || args->max_fps > 1000) {
+          printf ("--max-fps must be between 0 and 1000\n");
+          goto error;
+        }
+      } else if (strcmp (argv[i], "--menu-file") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->menu_file = argv[++i];
+      } else if (strcmp (argv[i], "--items-fd") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->items_fd = atoi (argv[++i]);
+      } else if (strcmp (argv[i], "--stream-items") == 0) {
+        // FBwhiptail specific arguments
+        if (i + 1 >= argc)
+          goto missing_value;
+        args->stream_fd = atoi (argv[++i]);
+      } else if (strcmp (argv[i], "--evdev") == 0) {
+        // FBwhiptail specific arguments
+        args->evdev = 1;
       } else if (strcmp (argv[i], "--text-size") == 0) {
         // FBwhiptail specific arguments
         if (i + 1 >= argc)
@@ -432,19 +1255,38 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
         printf ("Unknown argument : '%s'\n", argv[i]);
         goto error;
       }
-    } else if (args->mode == MODE_MENU) {
+    } else if (args->mode == MODE_MENU || args->mode == MODE_MIXEDGAUGE) {
       if (i + 1 >= argc)
         goto error;
 
       args->items[args->num_items].tag = argv[i++];
       args->items[args->num_items].item = argv[i];
       args->num_items++;
+    } else if (args->mode == MODE_CHECKLIST || args->mode == MODE_RADIOLIST) {
+      if (i + 2 >= argc)
+        goto error;
+
+      args->items[args->num_items].tag = argv[i++];
+      args->items[args->num_items].item = argv[i++];
+      if (strcasecmp (argv[i], "on") == 0) {
+        /* Only one item of a radiolist can be on, the last one wins */
+        if (args->mode == MODE_RADIOLIST) {
+          int on = bitset_next (&args->checked, 0);
+
+          if (on >= 0)
+            bitset_set (&args->checked, on, 0);
+        }
+        bitset_set (&args->checked, args->num_items, 1);
+      }
+      args->num_items++;
     } else {
       goto error;
     }
   }
   if (args->mode == MODE_NONE ||
-      (args->mode == MODE_MENU && args->num_items == 0))
+      (IS_LIST_MODE (args->mode) && args->num_items == 0 &&
+          args->menu_file == NULL && args->items_fd < 0 &&
+          args->stream_fd < 0))
     goto error;
   return 0;
  mode_already_set:
@@ -456,16 +1298,78 @@ int parse_whiptail_args (int argc, char **argv, whiptail_args *args)
  error:
   if (args->items)
     free (args->items);
+  bitset_clear (&args->checked);
   return -1;
 }
 
+static char *format_item_label(whiptail_menu_item *menu_item)
+{
+  size_t size = strlen (menu_item->tag) + strlen (menu_item->item) + 4;
+
+  if (size > item_label_size) {
+    char *label = realloc (item_label, size);
+
+    /* Better than nothing */
+    if (label == NULL)
+      return menu_item->item;
+    item_label = label;
+    item_label_size = size;
+  }
+  snprintf (item_label, item_label_size, "%s - %s", menu_item->tag,
+      menu_item->item);
+
+  return item_label;
+}
+
+static void menu_item_provider(CairoMenu *cmenu, CairoMenuItem *item,
+    void *user_data)
+{
+  whiptail_args *args = user_data;
+  whiptail_menu_item *menu_item = &args->items[item->index];
+
+  if (args->mode == MODE_CHECKLIST || args->mode == MODE_RADIOLIST) {
+    item->image = checkbox_images[bitset_get (&args->checked, item->index)];
+    item->image_position = CAIRO_MENU_IMAGE_POSITION_RIGHT;
+  }
+  if (args->notags)
+    item->text = menu_item->item;
+  else if (args->noitem)
+    item->text = menu_item->tag;
+  else
+    item->text = format_item_label (menu_item);
+  item->alignment = CAIRO_MENU_ALIGN_MIDDLE_LEFT;
+  item->ipad_x = STANDARD_MENU_ITEM_IPAD_X;
+  item->ipad_y = STANDARD_MENU_ITEM_IPAD_Y;
+}
+
+/* Add the items of the file after the ones given as arguments. The
+ * strings are not copied, @file must be kept open */
+static int load_menu_file (whiptail_args *args, menu_file_t *file)
+{
+  whiptail_menu_item *items;
+  int i;
+
+  items = realloc (args->items,
+      (args->num_items + file->nfields / 2) * sizeof(whiptail_menu_item));
+  if (items == NULL)
+    return -1;
+  args->items = items;
+
+  for (i = 0; i < file->nfields; i += 2) {
+    items[args->num_items].tag = file->fields[i];
+    items[args->num_items].item = file->fields[i + 1];
+    args->num_items++;
+  }
+
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
 #ifdef GTKWHIPTAIL
   GtkWidget *window;
   GtkWidget *area;
 #else
-  struct sigaction action;
   struct termios oldt, newt;
   cairo_t *cr;
   cairo_dri_t *dri = NULL;
@@ -474,14 +1378,20 @@ int main(int argc, char **argv)
   int *hdisplay = NULL, *vdisplay = NULL;
   int screens = 0;
   int current_fb = 0;
-  int redraw = 1;
-  int input_result = 0;
+  int stdin_flags = -1;
+  int sample_interval;
+  event_loop_t *loop = NULL;
+  whiptail_context ctx;
 #endif
   int i, idx;
   unsigned int xres, yres;
   Menu *menu = NULL;
+  menu_file_t *menu_file = NULL;
+  text_file_t *textbox = NULL;
+  tag_index_t *tags = NULL;
   whiptail_args args;
   int return_value = 0;
+  FILE *term = stdout;
 
   if (parse_whiptail_args (argc, argv, &args) != 0) {
     printf ("Invalid arguments received\n");
@@ -489,9 +1399,56 @@ int main(int argc, char **argv)
     return -1;
   }
 
+  if (args.menu_file || args.items_fd >= 0) {
+    if (args.menu_file)
+      menu_file = menu_file_open (args.menu_file);
+    else
+      menu_file = menu_file_open_fd (args.items_fd);
+    if (menu_file == NULL || load_menu_file (&args, menu_file) != 0) {
+      printf ("Error: Can't load the menu items : %s\n", strerror (errno));
+      return -1;
+    }
+    if (IS_LIST_MODE (args.mode) && args.num_items == 0 &&
+        args.stream_fd < 0) {
+      printf ("Error: No menu items\n");
+      return -1;
+    }
+  }
+
+  /* Mapped, not read, so even huge files open instantly */
+  if (args.mode == MODE_TEXTBOX) {
+    textbox = text_file_open (args.textbox);
+    if (textbox == NULL) {
+      printf ("Error: Can't open %s : %s\n", args.textbox, strerror (errno));
+      return -1;
+    }
+  }
+
+  /* Items loaded from a file start unchecked */
+  if ((args.mode == MODE_CHECKLIST || args.mode == MODE_RADIOLIST) &&
+      bitset_resize (&args.checked, args.num_items) != 0) {
+    printf ("Error: Can't allocate the checklist\n");
+    return -1;
+  }
+
+  /* Menus can be huge, so tags are looked up through a hash table */
+  if (IS_LIST_MODE (args.mode) || args.mode == MODE_MIXEDGAUGE) {
+    tags = tag_index_new (args.num_items + 1);
+    if (tags == NULL) {
+      printf ("Error: Can't index the menu items\n");
+      return -1;
+    }
+    for (i = 0; i < args.num_items; i++)
+      tag_index_add (tags, args.items[i].tag, i);
+  }
+
+  /* stdout carries the data being copied, keep it clean */
+  if (args.gauge_pipe)
+    term = stderr;
+
   if (args.clear) {
-    printf ("\033c");
-    fflush (stdout);
+    fprintf (term, "\033c");
+    fflush (term);
   }
 
 #ifdef GTKWHIPTAIL
@@ -507,10 +1464,21 @@ int main(int argc, char **argv)
   xres = WINDOW_WIDTH;
   yres = WINDOW_HEIGHT;
 #else
-  memset(&action, 0, sizeof(struct sigaction));
-  action.sa_handler = signal_handler;
-  sigaction(SIGTERM, &action, NULL);
-  sigaction(SIGINT, &action, NULL);
+  loop = event_loop_new ();
+  if (loop == NULL) {
+    printf ("Error: Can't create event loop\n");
+    return -1;
+  }
+  memset (&ctx, 0, sizeof(ctx));
+  ctx.gauge_percent = -1;
+  ctx.loop = loop;
+  ctx.escape_timer = event_loop_add_timer (loop, escape_timeout, &ctx);
+  ctx.frame_timer = event_loop_add_timer (loop, frame_timeout, &ctx);
+  ctx.prefetch_timer = event_loop_add_timer (loop, prefetch_timeout, &ctx);
+  ctx.type_ahead_timer = event_loop_add_timer (loop, type_ahead_timeout, &ctx);
+  gauge_parser_init (&ctx.gauge);
+  event_loop_add_signal (loop, SIGTERM, signal_received, NULL);
+  event_loop_add_signal (loop, SIGINT, signal_received, NULL);
 
   tcgetattr( STDIN_FILENO, &oldt);
   newt = oldt;
@@ -518,8 +1486,8 @@ int main(int argc, char **argv)
     that means it will return if it sees a "\n" or an EOF or an EOL*/
   newt.c_lflag &= ~(ICANON | ECHO);
   tcsetattr( STDIN_FILENO, TCSANOW, &newt);
-  printf ("\e[?25l"); // Hide blinking cursor (in case of linux FB)
-  fflush (stdout);
+  fprintf (term, "\e[?25l"); // Hide blinking cursor (in case of linux FB)
+  fflush (term);
 
   screens = 0;
   dri = cairo_dri_open("/dev/dri/card0");
@@ -595,7 +1563,7 @@ int main(int argc, char **argv)
   }
 
   if (screens == 0) {
-    printf ("Error: Can't find usable screen\n");
+    fprintf (term, "Error: Can't find usable screen\n");
     goto error;
   }
 #endif
@@ -620,27 +1588,25 @@ int main(int argc, char **argv)
   }
   */
 
-  if (args.mode == MODE_MENU) {
+  if (IS_LIST_MODE (args.mode)) {
     menu = standard_menu_create (args.title, args.text, args.text_size,
         xres, yres, -1, 1);
+    if (args.mode != MODE_MENU) {
+      int size = menu->menu->default_item_height -
+          (2 * STANDARD_MENU_ITEM_IPAD_Y);
+      int radio = (args.mode == MODE_RADIOLIST);
 
-    for (i = 0; i < args.num_items; i++) {
-      char *text;
-      whiptail_menu_item *item = &args.items[i];
-      if (args.notags || args.noitem) {
-        text = malloc ((args.notags ? strlen (item->item) : strlen (item->tag)) + 1);
-        strcpy (text, args.notags ? item->item : item->tag);
-      } else {
-        text = malloc (strlen (item->item) + strlen (item->tag) + 1 + 3);
-        strcpy (text, args.notags ? item->item : item->tag);
-        strcat (text, " - ");
-        strcat (text, item->item);
-      }
-      idx = standard_menu_add_item (menu, text, 20);
-      menu->menu->items[idx].alignment = CAIRO_MENU_ALIGN_MIDDLE_LEFT;
-      free (text);
-      if (i == 0 ||
-          (args.default_item && strcmp (args.default_item, item->tag) == 0)) {
+      checkbox_images[0] = create_standard_checkbox (size, radio, FALSE);
+      checkbox_images[1] = create_standard_checkbox (size, radio, TRUE);
+    }
+
+    /* Items are only formatted when they get shown */
+    cairo_menu_set_item_provider (menu->menu, args.num_items, 20,
+        menu_item_provider, &args);
+    cairo_menu_set_cache_pages (menu->menu, 4);
+    if (args.default_item) {
+      idx = tag_index_lookup (tags, args.default_item);
+      if (idx >= 0) {
         CairoMenuRectangle bbox;
         cairo_menu_set_selection (menu->menu, idx, &bbox);
       }
@@ -654,7 +1620,13 @@ int main(int argc, char **argv)
     menu = standard_menu_create (args.title, args.text, args.text_size,
         xres, yres, -1, 1);
     standard_menu_add_item (menu, args.ok_button, 20);
-  } else if (args.mode == MODE_GAUGE) {
+  } else if (args.mode == MODE_TEXTBOX) {
+    menu = standard_menu_create (args.title, "", args.text_size,
+        xres, yres, -1, 1);
+    standard_menu_set_text_file (menu, textbox);
+    textbox = NULL;
+    standard_menu_add_item (menu, args.ok_button, 20);
+  } else if (args.mode == MODE_GAUGE || args.mode == MODE_MIXEDGAUGE) {
     menu = standard_menu_create (args.title, args.text, args.text_size,
         xres, yres, -1, 1);
     menu->gauge = 1;
@@ -664,8 +1636,15 @@ int main(int argc, char **argv)
     menu->gauge_rgb[3] = args.gauge_rgb[3];
     menu->gauge_rgb[4] = args.gauge_rgb[4];
     menu->gauge_rgb[5] = args.gauge_rgb[5];
-    standard_menu_add_item (menu, "Gauge", 20);
-    standard_menu_update_gauge (menu, args.gauge_percent);
+    if (args.mode == MODE_MIXEDGAUGE) {
+      /* One bar per item, then the overall progress */
+      for (i = 0; i < args.num_items; i++)
+        standard_menu_add_gauge (menu, args.items[i].tag, 20);
+      standard_menu_add_gauge (menu, "Overall", 20);
+    } else {
+      standard_menu_add_gauge (menu, "Gauge", 20);
+      standard_menu_update_gauge (menu, args.gauge_percent);
+    }
   }
   if (args.background_png)
     menu->background = load_image_and_scale (args.background_png, xres, yres);
@@ -685,15 +1664,115 @@ int main(int argc, char **argv)
   if (result) {
     if (args.mode == MODE_MENU)
       fprintf (stderr, "%s", args.items[menu->menu->selection].tag);
+    else if (args.mode == MODE_CHECKLIST || args.mode == MODE_RADIOLIST)
+      write_checked_tags (&args);
     else if (args.mode == MODE_YESNO) {
       if (menu->menu->selection != 0)
         return_value = 1;
     }
   }
 #else
-  while (!cancel) {
+  ctx.menu = menu;
+  ctx.args = &args;
+  ctx.dri = dri;
+  ctx.tags = tags;
+  ctx.redraw = 1;
+  if (IS_LIST_MODE (args.mode))
+    ctx.type_ahead = type_ahead_new (args.num_items, menu_item_key, &args);
+
+  if (args.mode == MODE_MIXEDGAUGE) {
+    ctx.nbars = args.num_items + 1;
+    ctx.bars = malloc (ctx.nbars * sizeof(mixed_gauge_bar));
+    memset (ctx.bars, 0, ctx.nbars * sizeof(mixed_gauge_bar));
+    for (i = 0; i < args.num_items; i++) {
+      ctx.bars[i].tag = args.items[i].tag;
+      ctx.bars[i].item = i;
+      set_mixed_gauge_status (&ctx, &ctx.bars[i], args.items[i].item);
+    }
+    ctx.bars[i].tag = "Overall";
+    ctx.bars[i].item = i;
+    tag_index_add (tags, ctx.bars[i].tag, i);
+    update_gauge (&ctx, args.gauge_percent, NULL);
+    ctx.gauge.item_cb = mixed_gauge_item;
+    ctx.gauge.user_data = &ctx;
+  }
+
+  /* Without a terminal there is no other way to get key presses */
+  if (args.evdev || (!isatty (STDIN_FILENO) && !menu->gauge))
+    ctx.evdev = evdev_input_new (loop, evdev_key, evdev_pointer, &ctx);
+  if (ctx.evdev) {
+    ctx.screen_x = (hdisplay[0] - xres) / 2;
+    ctx.screen_y = (vdisplay[0] - yres) / 2;
+    evdev_input_set_screen_size (ctx.evdev, hdisplay[0], vdisplay[0]);
+  }
 
-    if (redraw) {
+  /* Progress that we have to poll for is sampled once per frame */
+  sample_interval = 1000 / (args.max_fps > 0 ? args.max_fps : DEFAULT_MAX_FPS);
+  /* A 0ms interval would disarm the sampling timers */
+  if (sample_interval < 1)
+    sample_interval = 1;
+  stdin_flags = fcntl (STDIN_FILENO, F_GETFL);
+  fcntl (STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
+  if (args.mode == MODE_GAUGE && args.gauge_shm) {
+    int timer;
+
+    ctx.shm = gauge_shm_open (args.gauge_shm);
+    if (ctx.shm == NULL) {
+      fprintf (term, "Error: Can't open %s\n", args.gauge_shm);
+      goto error;
+    }
+    timer = event_loop_add_timer (loop, shm_sample, &ctx);
+    event_loop_timer_set (loop, timer, sample_interval, sample_interval);
+  } else if (args.mode == MODE_GAUGE && (args.gauge_pid || args.gauge_file)) {
+    int timer;
+
+    if (args.gauge_file) {
+      ctx.fdinfo = gauge_fdinfo_open_file (args.gauge_file);
+    } else {
+      ctx.fdinfo = gauge_fdinfo_open_pid (args.gauge_pid, args.gauge_pid_fd);
+      if (ctx.fdinfo)
+        args.gauge_size = gauge_fdinfo_get_size (ctx.fdinfo);
+    }
+    if (ctx.fdinfo == NULL) {
+      fprintf (term, "Error: Can't follow the progress of the file\n");
+      goto error;
+    }
+    timer = event_loop_add_timer (loop, fdinfo_sample, &ctx);
+    event_loop_timer_set (loop, timer, sample_interval, sample_interval);
+  } else if (args.mode == MODE_GAUGE && args.gauge_pipe) {
+    /* If the consumer goes away, the copy has to fail with EPIPE rather than
+     * kill us before the terminal gets restored */
+    signal (SIGPIPE, SIG_IGN);
+    ctx.pipe = gauge_pipe_new (loop, STDIN_FILENO, STDOUT_FILENO,
+        pipe_progress, &ctx);
+    if (ctx.pipe == NULL) {
+      fprintf (term, "Error: Can't forward stdin to stdout\n");
+      goto error;
+    }
+  } else if (IS_LIST_MODE (args.mode) && args.stream_fd >= 0) {
+    /* Items can come through stdin, keys then come from evdev */
+    ctx.allocated_items = args.num_items;
+    ctx.stream = menu_stream_new (loop, args.stream_fd, stream_item, &ctx);
+    if (ctx.stream == NULL) {
+      fprintf (term, "Error: Can't read the menu items\n");
+      goto error;
+    }
+    if (args.stream_fd != STDIN_FILENO)
+      event_loop_add_fd (loop, STDIN_FILENO, POLLIN, stdin_ready, &ctx);
+  } else {
+    event_loop_add_fd (loop, STDIN_FILENO, POLLIN, stdin_ready, &ctx);
+  }
+  if (dri)
+    event_loop_add_fd (loop, dri->dri_fd, POLLIN, dri_ready, &ctx);
+
+  while (!cancel) {
+    /* Wait for the previous frame to be on screen before drawing the next,
+     * and don't draw more often than --max-fps, updates received in the
+     * meantime are merged into the next frame */
+    if (ctx.redraw && ctx.flips_pending == 0 && !ctx.frame_throttled) {
+      apply_gauge (&ctx);
+      if (ctx.bars)
+        apply_mixed_gauge (&ctx);
       for (i = 0; i < screens; i++) {
         cr = crs[i*2+current_fb];
         cairo_save (cr);
@@ -710,10 +1789,13 @@ int main(int argc, char **argv)
         menu->draw (menu, cr);
         cairo_restore (cr);
         if (dri) {
-          if (cairo_dri_flip_buffer (surfaces[i*2 + current_fb], 0) != 0) {
-            printf ("Flip failed. Cancelling\n");
+          int flip = cairo_dri_flip_buffer (surfaces[i*2 + current_fb], 1);
+
+          if (flip < 0) {
+            fprintf (term, "Flip failed. Cancelling\n");
             break;
           }
+          ctx.flips_pending += flip;
         } else {
           int next_fb = (current_fb + 1) % 2;
 
@@ -721,32 +1803,32 @@ int main(int argc, char **argv)
             current_fb = next_fb;
           else if (cairo_linuxfb_flip_buffer (surfaces[i*2 + current_fb],
                   1, current_fb) != 0) {
-            printf ("Flip failed. Cancelling\n");
+            fprintf (term, "Flip failed. Cancelling\n");
             break;
           }
         }
       }
       current_fb = (current_fb + 1) % 2;
-      redraw = 0;
-    }
-    input_result = handle_input (menu);
-    if (input_result == 1)
-      redraw = 1;
-    else if (input_result == 2) {
-      if (args.mode == MODE_MENU)
-        fprintf (stderr, "%s", args.items[menu->menu->selection].tag);
-      else if (args.mode == MODE_YESNO) {
-        if (menu->menu->selection != 0)
-          return_value = 1;
-      }
+      ctx.redraw = 0;
+      if (menu->menu->cache_pages)
+        event_loop_timer_set (loop, ctx.prefetch_timer, PREFETCH_DELAY, 0);
+      if (args.max_fps > 0 &&
+          event_loop_timer_set (loop, ctx.frame_timer,
+              1000 / args.max_fps, 0) == 0)
+        ctx.frame_throttled = 1;
     }
+    if (event_loop_iterate (loop, -1) < 0)
+      break;
   }
+  return_value = ctx.return_value;
 
  error:
   /*restore the old settings*/
-  printf ("\e[?25h");
-  fflush (stdout);
+  fprintf (term, "\e[?25h");
+  fflush (term);
   tcsetattr( STDIN_FILENO, TCSANOW, &oldt);
+  if (stdin_flags != -1)
+    fcntl (STDIN_FILENO, F_SETFL, stdin_flags);
   for (i = 0; i < screens * 2; i++) {
     if (crs[i])
       cairo_destroy(crs[i]);
@@ -763,13 +1845,39 @@ int main(int argc, char **argv)
     free (vdisplay);
   if (dri)
     cairo_dri_close (dri);
+  if (ctx.evdev)
+    evdev_input_free (ctx.evdev);
+  gauge_parser_clear (&ctx.gauge);
+  free (ctx.gauge_text);
+  if (ctx.bars)
+    free (ctx.bars);
+  if (ctx.shm)
+    gauge_shm_close (ctx.shm);
+  if (ctx.pipe)
+    gauge_pipe_free (ctx.pipe);
+  if (ctx.fdinfo)
+    gauge_fdinfo_close (ctx.fdinfo);
+  if (ctx.type_ahead)
+    type_ahead_free (ctx.type_ahead);
+  if (ctx.stream)
+    menu_stream_free (ctx.stream);
+  event_loop_free (loop);
 #endif
 
-  if (menu) {
-    if (menu->menu)
-      cairo_menu_free (menu->menu);
-    free (menu);
+  if (menu)
+    standard_menu_free (menu);
+  if (tags)
+    tag_index_free (tags);
+  if (menu_file)
+    menu_file_close (menu_file);
+  if (textbox)
+    text_file_close (textbox);
+  for (i = 0; i < 2; i++) {
+    if (checkbox_images[i])
+      cairo_surface_destroy (checkbox_images[i]);
   }
+  free (item_label);
+  bitset_clear (&args.checked);
 
   return return_value;
 }
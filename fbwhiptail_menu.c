@@ -30,6 +30,8 @@
 #include "fbwhiptail_menu.h"
 
 #define TEXT_PAD 5
+/* Wider than the screen at any font size the text can use */
+#define TEXT_LINE_MAX 256
 
 cairo_surface_t *
 create_gradient_background (int width, int height,
@@ -98,6 +100,24 @@ draw_background (Menu *menu, cairo_t *cr)
   }
 }
 
+/* The text and the items, up to the maximum size of the frame */
+static int
+get_standard_menu_content_height (Menu *menu)
+{
+  int height;
+
+  // If horizontal, don't extend frame downward
+  if (menu->menu->rows == 1)
+    height = STANDARD_MENU_ITEM_TOTAL_HEIGHT;
+  else
+    height = menu->menu->nitems * STANDARD_MENU_ITEM_TOTAL_HEIGHT;
+  height += cairo_utils_get_surface_height (menu->text.surface);
+  if (height > STANDARD_MENU_HEIGHT)
+    height = STANDARD_MENU_HEIGHT;
+
+  return height;
+}
+
 static void
 create_standard_menu_frame (Menu *menu)
 {
@@ -111,15 +131,8 @@ create_standard_menu_frame (Menu *menu)
 
   /* Adapt frame height depending on items in the menu */
   width = STANDARD_MENU_FRAME_WIDTH;
-  // If horizontal, don't extend frame downward
-  if (menu->menu->rows == 1)
-    height = STANDARD_MENU_ITEM_TOTAL_HEIGHT;
-  else
-    height = menu->menu->nitems * STANDARD_MENU_ITEM_TOTAL_HEIGHT;
-  height += cairo_utils_get_surface_height (menu->text.surface);
-  if (height > STANDARD_MENU_HEIGHT)
-    height = STANDARD_MENU_HEIGHT;
-  height += STANDARD_MENU_FRAME_HEIGHT;
+  menu->frame_content_height = get_standard_menu_content_height (menu);
+  height = menu->frame_content_height + STANDARD_MENU_FRAME_HEIGHT;
 
   frame = cairo_image_surface_create  (CAIRO_FORMAT_ARGB32,
       width, height);
@@ -175,6 +188,129 @@ create_standard_menu_frame (Menu *menu)
   cairo_surface_destroy (frame);
 }
 
+/* Only the lines on screen are read from the file, one at a time */
+static void
+draw_text_file_lines (Menu *menu, cairo_t *cr, int first, int count)
+{
+  char buffer[TEXT_LINE_MAX + 1];
+  const char *text;
+  size_t len, i;
+  int line, n;
+
+  cairo_select_font_face (cr,
+      "monospace",
+      CAIRO_FONT_SLANT_NORMAL,
+      CAIRO_FONT_WEIGHT_BOLD);
+  cairo_set_font_size (cr, menu->text_size);
+  cairo_set_source_rgb (cr, 1, 1, 1);
+
+  for (line = first; line < first + count; line++) {
+    if (text_file_get_line (menu->text.file, menu->text.start_line + line,
+            &text, &len) < 0)
+      break;
+
+    /* Expand tabs since the font is monospace, NULs would cut the line */
+    n = 0;
+    for (i = 0; i < len && n < TEXT_LINE_MAX; i++) {
+      if (text[i] == '\t') {
+        do {
+          buffer[n++] = ' ';
+        } while (n % 8 != 0 && n < TEXT_LINE_MAX);
+      } else {
+        buffer[n++] = text[i] ? text[i] : ' ';
+      }
+    }
+    /* Don't cut a long line in the middle of a UTF-8 character */
+    if (i < len) {
+      while (n > 0 && (text[i] & 0xC0) == 0x80) {
+        n--;
+        i--;
+      }
+    }
+    buffer[n] = 0;
+
+    cairo_move_to (cr, 0, (line + 1) * menu->text_size + TEXT_PAD);
+    cairo_show_text (cr, buffer);
+  }
+}
+
+/* Clear rows @y0 to @y1 of the text and draw what belongs there again */
+static void
+redraw_text_rows (Menu *menu, cairo_t *cr, cairo_font_extents_t *fex,
+    int y0, int y1)
+{
+  int line, baseline;
+
+  if (y0 < 0)
+    y0 = 0;
+  if (y1 <= y0)
+    return;
+
+  cairo_save (cr);
+  cairo_rectangle (cr, 0, y0, cairo_utils_get_surface_width (menu->text.surface),
+      y1 - y0);
+  cairo_clip (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  /* Lines overlap a bit, so redraw all the ones reaching into the rows */
+  for (line = 0; line < menu->text.nlines; line++) {
+    baseline = (line + 1) * menu->text_size + TEXT_PAD;
+    if (baseline - fex->ascent < y1 && baseline + fex->descent > y0)
+      draw_text_file_lines (menu, cr, line, 1);
+  }
+  cairo_restore (cr);
+}
+
+/*
+ * Scrolling a textbox by one line moves the pixels of the others, then only
+ * the rows around the line that came into view and the one that went out
+ * get drawn again.
+ */
+static int
+scroll_text_surface (Menu *menu)
+{
+  cairo_surface_t *surface = menu->text.surface;
+  int line_height = menu->text_size;
+  int height = cairo_utils_get_surface_height (surface);
+  int nlines = menu->text.nlines;
+  cairo_font_extents_t fex;
+  int ascent, descent;
+  cairo_t *cr;
+
+  if (cairo_utils_image_surface_scroll (surface, 0,
+          -menu->text.scroll * line_height) != 0)
+    return -1;
+
+  cr = cairo_create (surface);
+  cairo_select_font_face (cr,
+      "monospace",
+      CAIRO_FONT_SLANT_NORMAL,
+      CAIRO_FONT_WEIGHT_BOLD);
+  cairo_set_font_size (cr, menu->text_size);
+  cairo_font_extents (cr, &fex);
+  ascent = ceil (fex.ascent);
+  descent = ceil (fex.descent);
+
+  if (menu->text.scroll > 0) {
+    /* The old first line is cut at the top, the last line is new */
+    redraw_text_rows (menu, cr, &fex, 0, TEXT_PAD + descent);
+    redraw_text_rows (menu, cr, &fex,
+        nlines * line_height + TEXT_PAD - ascent, height);
+  } else {
+    /* The first line is new, the old last line is pushed down */
+    redraw_text_rows (menu, cr, &fex, 0, line_height + TEXT_PAD + descent);
+    redraw_text_rows (menu, cr, &fex,
+        (nlines + 1) * line_height + TEXT_PAD - ascent, height);
+  }
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+  menu->text.scroll = 0;
+
+  return 0;
+}
+
 static void
 refresh_text_surface (Menu *menu)
 {
@@ -186,12 +322,27 @@ refresh_text_surface (Menu *menu)
   int cnt = menu->text.start_line;
   cairo_t *cr;
 
+  /* The text only changes when it gets replaced or scrolled */
+  if (!menu->text.dirty && menu->text.scroll == 0)
+    return;
+  if (!menu->text.dirty && scroll_text_surface (menu) == 0)
+    return;
+  menu->text.scroll = 0;
+
   cr = cairo_create (menu->text.surface);
   x = 0;
   y = 0;
 
+  cairo_save (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_restore (cr);
+
+  if (menu->text.file)
+    draw_text_file_lines (menu, cr, 0, menu->text.nlines);
+
   line = menu->text.lines;
-  while (*line != NULL && y + menu->text_size < height) {
+  while (line != NULL && *line != NULL && y + menu->text_size < height) {
     if (cnt > 0) {
       cnt--;
       line++;
@@ -215,7 +366,91 @@ refresh_text_surface (Menu *menu)
     y += menu->text_size;
     line++;
   }
+  cairo_destroy (cr);
+  cairo_surface_flush (menu->text.surface);
+  menu->text.dirty = FALSE;
+}
 
+/* Where the menu surface gets painted, the frame must have been created */
+static void
+get_standard_menu_origin (Menu *menu, int *x, int *y)
+{
+  int w, h;
+
+  cairo_utils_get_surface_size (menu->frame, &w, &h);
+  *x = ((menu->width - w) / 2) + STANDARD_MENU_FRAME_SIDE;
+  *y = ((menu->height - h) / 2) + STANDARD_MENU_FRAME_TOP +
+      cairo_utils_get_surface_height (menu->text.surface);
+}
+
+int
+standard_menu_to_menu_coords (Menu *menu, int *x, int *y)
+{
+  int origin_x, origin_y;
+
+  /* Nothing was drawn yet */
+  if (menu->frame == NULL || menu->text.surface == NULL)
+    return -1;
+
+  get_standard_menu_origin (menu, &origin_x, &origin_y);
+  *x -= origin_x;
+  *y -= origin_y;
+
+  return 0;
+}
+
+static void
+paint_gauge_span (Menu *menu, cairo_surface_t *gauge, int *done,
+    int done_width)
+{
+  cairo_surface_t *source;
+  int from, to;
+  cairo_t *cr;
+
+  /* Growing bars get the full bar painted over the new span, shrinking ones
+   * get the empty one */
+  if (done_width > *done) {
+    source = menu->gauge_full;
+    from = *done;
+    to = done_width;
+  } else {
+    source = menu->gauge_empty;
+    from = done_width;
+    to = *done;
+  }
+
+  cr = cairo_create (gauge);
+  cairo_rectangle (cr, STANDARD_MENU_BOX_X + from, 0, to - from,
+      cairo_utils_get_surface_height (gauge));
+  cairo_clip (cr);
+  cairo_set_source_surface (cr, source, 0, 0);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_surface_flush (gauge);
+
+  *done = done_width;
+}
+
+/* Paint the bars that changed since the last frame */
+static void
+apply_gauge_updates (Menu *menu)
+{
+  CairoMenuItem *item;
+  int i;
+
+  for (i = 0; i < menu->gauge_slots; i++) {
+    if (!menu->gauge_changed[i])
+      continue;
+    menu->gauge_changed[i] = FALSE;
+    item = &menu->menu->items[i];
+    if (menu->gauge_width[i] != menu->gauge_done[i])
+      paint_gauge_span (menu, item->bg_image, &menu->gauge_done[i],
+          menu->gauge_width[i]);
+    /* Everything gets drawn anyway when the menu is dirty */
+    if (!menu->menu->dirty)
+      cairo_menu_redraw_item (menu->menu, i);
+  }
 }
 
 static void
@@ -223,20 +458,29 @@ draw_standard_menu (Menu *menu, cairo_t *cr)
 {
   cairo_surface_t *surface;
   int w, h;
+  int origin_x, origin_y;
   int menu_width;
   int menu_height;
   int text_height;
 
+  /* Items may have been added since, until the frame reaches its maximum */
+  if (menu->frame &&
+      menu->frame_content_height != get_standard_menu_content_height (menu)) {
+    cairo_surface_destroy (menu->frame);
+    menu->frame = NULL;
+  }
   if (menu->frame == NULL) {
     create_standard_menu_frame (menu);
   }
   refresh_text_surface (menu);
+  apply_gauge_updates (menu);
 
   cairo_utils_get_surface_size (menu->frame, &w, &h);
   text_height = cairo_utils_get_surface_height (menu->text.surface);
   surface = cairo_menu_get_surface (menu->menu);
 
-  cairo_menu_redraw (menu->menu);
+  if (menu->menu->dirty)
+    cairo_menu_redraw (menu->menu);
 
   cairo_set_source_surface (cr, menu->frame, (menu->width - w) / 2,
       (menu->height - h) / 2);
@@ -257,8 +501,8 @@ draw_standard_menu (Menu *menu, cairo_t *cr)
     menu_height = STANDARD_MENU_HEIGHT - text_height;
 
   cairo_save (cr);
-  cairo_translate (cr, ((menu->width - w) / 2) + STANDARD_MENU_FRAME_SIDE,
-      ((menu->height - h) / 2) + STANDARD_MENU_FRAME_TOP + text_height);
+  get_standard_menu_origin (menu, &origin_x, &origin_y);
+  cairo_translate (cr, origin_x, origin_y);
 
   if (!menu->gauge) {
     /* Draw a frame around the menu so cut off buttons don't appear clippped */
@@ -324,40 +568,64 @@ create_standard_background (int width, int height, float r, float g, float b) {
   return background;
 }
 
-char *
-load_text_from_file (char *filename)
+cairo_surface_t *
+create_standard_checkbox (int size, int radio, int checked)
 {
- FILE* fd = NULL;
- char *text = NULL;
- int filesize;
-
- fd = fopen(filename,"rb");
- if (fd != NULL) {
-   fseek(fd, 0, SEEK_END);
-   filesize = ftell(fd);
-   fseek(fd, 0, SEEK_SET);
-
-   text = (char*) malloc(filesize + 1);
-   fread(text, 1, filesize, fd);
-   text[filesize] = 0;
-   fclose(fd);
- }
+  cairo_surface_t *checkbox;
+  cairo_t *cr;
+  double margin = size * 0.2;
+
+  checkbox = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, size, size);
+  cr = cairo_create (checkbox);
+
+  // Silver box or circle, with a dark inside
+  if (radio)
+    cairo_arc (cr, size / 2.0, size / 2.0, size / 2.0 - margin, 0, 2 * M_PI);
+  else
+    cairo_rectangle (cr, margin, margin, size - (2 * margin),
+        size - (2 * margin));
+  cairo_set_source_rgba (cr, 0, 0, 0, 0.4);
+  cairo_fill_preserve (cr);
+  cairo_set_source_rgb (cr, 0.7, 0.7, 0.7);
+  cairo_set_line_width (cr, 2);
+  cairo_stroke (cr);
+
+  if (checked) {
+    cairo_set_source_rgb (cr, 0.9, 0.9, 0.9);
+    if (radio) {
+      cairo_arc (cr, size / 2.0, size / 2.0, size / 2.0 - (2 * margin),
+          0, 2 * M_PI);
+      cairo_fill (cr);
+    } else {
+      cairo_move_to (cr, margin * 1.5, size / 2.0);
+      cairo_line_to (cr, size * 0.45, size - (margin * 1.5));
+      cairo_line_to (cr, size - (margin * 1.5), margin * 1.5);
+      cairo_set_line_width (cr, size * 0.1);
+      cairo_stroke (cr);
+    }
+  }
+  cairo_destroy (cr);
+  cairo_surface_flush (checkbox);
 
- return text;
+  return checkbox;
 }
 
 void
-create_text_suface (Menu *menu, char *text, int text_size)
+create_text_suface (Menu *menu, const char *text, int text_size)
 {
   char *ptr, *ptr2;
   int filesize;
   int lines;
 
  memset (&menu->text, 0, sizeof(MenuText));
+ arena_init (&menu->text.arena, 0);
+
+ /* Keep our own copy since it gets split into lines in place */
+ menu->text.buffer = arena_strdup (&menu->text.arena, text);
 
  /* Calculate number of lines */
  lines = 0;
- ptr = ptr2 = text;
+ ptr = ptr2 = menu->text.buffer;
  while (*ptr != 0) {
    if (*ptr == '\\' && ptr[1] == 'n') {
      *ptr2 = '\n';
@@ -373,9 +641,10 @@ create_text_suface (Menu *menu, char *text, int text_size)
  /* Last line */
  lines++;
 
- menu->text.lines = malloc ((lines + 1) * sizeof(char *));
+ menu->text.lines = arena_alloc (&menu->text.arena,
+     (lines + 1) * sizeof(char *));
  menu->text.nlines = 0;
- ptr = text;
+ ptr = menu->text.buffer;
  while (*ptr != 0) {
    if (*ptr != '\r')
      menu->text.lines[menu->text.nlines++] = ptr;
@@ -392,10 +661,22 @@ create_text_suface (Menu *menu, char *text, int text_size)
 
  menu->text.surface = cairo_image_surface_create  (CAIRO_FORMAT_ARGB32,
      STANDARD_MENU_WIDTH, 10 + (text_size + TEXT_PAD) * menu->text.nlines);
+ menu->text.dirty = TRUE;
+}
+
+void
+free_text (Menu *menu)
+{
+  arena_clear (&menu->text.arena);
+  if (menu->text.file != NULL)
+    text_file_close (menu->text.file);
+  if (menu->text.surface != NULL)
+    cairo_surface_destroy (menu->text.surface);
+  memset (&menu->text, 0, sizeof(MenuText));
 }
 
 Menu *
-standard_menu_create (const char *title, char * text, int text_size,
+standard_menu_create (const char *title, const char *text, int text_size,
     int width, int height, int rows, int columns)
 {
   cairo_surface_t *surface;
@@ -451,6 +732,134 @@ standard_menu_create (const char *title, char * text, int text_size,
   return menu;
 }
 
+void
+standard_menu_free (Menu *menu)
+{
+  free_text (menu);
+  if (menu->menu)
+    cairo_menu_free (menu->menu);
+  if (menu->background)
+    cairo_surface_destroy (menu->background);
+  if (menu->frame)
+    cairo_surface_destroy (menu->frame);
+  if (menu->gauge_full)
+    cairo_surface_destroy (menu->gauge_full);
+  if (menu->gauge_empty)
+    cairo_surface_destroy (menu->gauge_empty);
+  free (menu->gauge_done);
+  free (menu->gauge_width);
+  free (menu->gauge_changed);
+  free (menu);
+}
+
+static void
+text_surface_changed (Menu *menu)
+{
+  cairo_surface_t *surface;
+  int text_height;
+
+  text_height = cairo_utils_get_surface_height (menu->text.surface);
+
+  /* The frame and the menu area both depend on the height of the text */
+  if (menu->frame) {
+    cairo_surface_destroy (menu->frame);
+    menu->frame = NULL;
+  }
+  surface = cairo_image_surface_create  (CAIRO_FORMAT_ARGB32,
+      STANDARD_MENU_WIDTH, STANDARD_MENU_HEIGHT - text_height);
+  cairo_surface_destroy (menu->menu->surface);
+  menu->menu->surface = surface;
+  menu->menu->dirty = TRUE;
+}
+
+void
+standard_menu_set_text (Menu *menu, const char *text)
+{
+  free_text (menu);
+  create_text_suface (menu, text, menu->text_size);
+  text_surface_changed (menu);
+}
+
+/*
+ * The menu takes over @file, which only gets indexed as far as it is
+ * scrolled. The text area gets a fixed number of lines, leaving room for
+ * the button below it.
+ */
+void
+standard_menu_set_text_file (Menu *menu, text_file_t *file)
+{
+  int nlines;
+
+  free_text (menu);
+  arena_init (&menu->text.arena, 0);
+  menu->text.file = file;
+
+  nlines = (STANDARD_MENU_HEIGHT - STANDARD_MENU_ITEM_TOTAL_HEIGHT - 10) /
+      (menu->text_size + TEXT_PAD);
+  if (nlines < 1)
+    nlines = 1;
+  menu->text.nlines = nlines;
+  menu->text.surface = cairo_image_surface_create  (CAIRO_FORMAT_ARGB32,
+      STANDARD_MENU_WIDTH, 10 + (menu->text_size + TEXT_PAD) * nlines);
+  menu->text.dirty = TRUE;
+  text_surface_changed (menu);
+}
+
+/* Returns TRUE if the text of a textbox moved */
+int
+standard_menu_scroll_text (Menu *menu, CairoMenuInput input)
+{
+  text_file_t *file = menu->text.file;
+  int page = menu->text.nlines;
+  int start = menu->text.start_line;
+  const char *text;
+  size_t len;
+
+  if (file == NULL)
+    return FALSE;
+
+  switch (input) {
+    case CAIRO_MENU_INPUT_UP:
+      start--;
+      break;
+    case CAIRO_MENU_INPUT_DOWN:
+      start++;
+      break;
+    case CAIRO_MENU_INPUT_PAGE_UP:
+      start -= page;
+      break;
+    case CAIRO_MENU_INPUT_PAGE_DOWN:
+      start += page;
+      break;
+    case CAIRO_MENU_INPUT_HOME:
+      start = 0;
+      break;
+    case CAIRO_MENU_INPUT_END:
+      start = text_file_count_lines (file) - page;
+      break;
+    default:
+      return FALSE;
+  }
+
+  /* Stop with the last line at the bottom, the whole file only needs to be
+   * indexed once we get there */
+  if (start > menu->text.start_line &&
+      text_file_get_line (file, start + page - 1, &text, &len) < 0)
+    start = text_file_count_lines (file) - page;
+  if (start < 0)
+    start = 0;
+  if (start == menu->text.start_line)
+    return FALSE;
+
+  /* Single lines get scrolled in, anything more is drawn again */
+  menu->text.scroll += start - menu->text.start_line;
+  if (abs (menu->text.scroll) > 1)
+    menu->text.dirty = TRUE;
+  menu->text.start_line = start;
+
+  return TRUE;
+}
+
 int
 standard_menu_add_tag (Menu *menu, const char *title, int fontsize)
 {
@@ -473,15 +882,6 @@ standard_menu_add_item (Menu *menu, const char *title, int fontsize)
   return idx;
 }
 
-void
-free_text (Menu *menu)
-{
-  if (menu->text.lines != NULL && menu->text.lines[0] != NULL)
-    free (menu->text.lines[0]);
-  if (menu->text.lines != NULL)
-    free (menu->text.lines);
-}
-
 cairo_surface_t *
 create_standard_gauge (int width, int height, unsigned int percent,
     float dr, float dg, float db, float r, float g, float b) {
@@ -543,27 +943,103 @@ create_standard_gauge (int width, int height, unsigned int percent,
   return background;
 }
 
-void standard_menu_update_gauge (Menu *menu, unsigned int percent) {
-  CairoMenuItem *item = &menu->menu->items[0];
-  char percent_text[6];
+int
+standard_menu_add_gauge (Menu *menu, const char *label, int fontsize)
+{
+  CairoMenuItem *item;
   cairo_surface_t *gauge;
+  cairo_t *cr;
+  int *gauge_done;
+  int *gauge_width;
+  char *gauge_changed;
+  int idx;
 
-  if (percent > 100)
-    percent = 100;
+  idx = standard_menu_add_item (menu, label, fontsize);
+  if (idx < 0)
+    return idx;
+  item = &menu->menu->items[idx];
+
+  /* Render the empty and full bars once, updates only copy the span that
+   * changed from one of them into the item's background */
+  if (menu->gauge_full == NULL) {
+    menu->gauge_full = create_standard_gauge (STANDARD_MENU_ITEM_BOX_WIDTH,
+        STANDARD_MENU_ITEM_BOX_HEIGHT, 100,
+        menu->gauge_rgb[0], menu->gauge_rgb[1], menu->gauge_rgb[2],
+        menu->gauge_rgb[3], menu->gauge_rgb[4], menu->gauge_rgb[5]);
+    menu->gauge_empty = create_standard_gauge (STANDARD_MENU_ITEM_BOX_WIDTH,
+        STANDARD_MENU_ITEM_BOX_HEIGHT, 0,
+        menu->gauge_rgb[0], menu->gauge_rgb[1], menu->gauge_rgb[2],
+        menu->gauge_rgb[3], menu->gauge_rgb[4], menu->gauge_rgb[5]);
+  }
 
-  gauge = create_standard_gauge (STANDARD_MENU_ITEM_BOX_WIDTH,
-      STANDARD_MENU_ITEM_BOX_HEIGHT, percent,
-      menu->gauge_rgb[0], menu->gauge_rgb[1], menu->gauge_rgb[2],
-      menu->gauge_rgb[3], menu->gauge_rgb[4], menu->gauge_rgb[5]);
-  snprintf (percent_text, sizeof(percent_text), "%d%%", percent);
+  gauge_done = realloc (menu->gauge_done, (idx + 1) * sizeof(int));
+  if (gauge_done == NULL)
+    return -1;
+  menu->gauge_done = gauge_done;
+  menu->gauge_done[idx] = 0;
+  gauge_width = realloc (menu->gauge_width, (idx + 1) * sizeof(int));
+  if (gauge_width == NULL)
+    return -1;
+  menu->gauge_width = gauge_width;
+  menu->gauge_width[idx] = 0;
+  gauge_changed = realloc (menu->gauge_changed, idx + 1);
+  if (gauge_changed == NULL)
+    return -1;
+  menu->gauge_changed = gauge_changed;
+  /* Items between two gauges aren't bars and never change */
+  memset (menu->gauge_changed + menu->gauge_slots, 0,
+      idx + 1 - menu->gauge_slots);
+  menu->gauge_slots = idx + 1;
+
+  gauge = cairo_image_surface_create  (CAIRO_FORMAT_ARGB32,
+      STANDARD_MENU_ITEM_BOX_WIDTH, STANDARD_MENU_ITEM_BOX_HEIGHT);
+  cr = cairo_create (gauge);
+  cairo_set_source_surface (cr, menu->gauge_empty, 0, 0);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint (cr);
+  cairo_destroy (cr);
 
-  //item->enabled = FALSE;
-  if (item->text)
-    free (item->text);
-  item->text = strdup (percent_text);
   cairo_surface_destroy (item->bg_image);
   cairo_surface_destroy (item->bg_sel_image);
   item->bg_image = cairo_surface_reference (gauge);
   item->bg_sel_image = cairo_surface_reference (gauge);
   cairo_surface_destroy (gauge);
+  menu->menu->dirty = TRUE;
+
+  return idx;
+}
+
+void
+standard_menu_update_gauge_item (Menu *menu, int index, unsigned int percent,
+    const char *label)
+{
+  CairoMenuItem *item = &menu->menu->items[index];
+  int label_changed;
+  int done_width;
+
+  if (percent > 100)
+    percent = 100;
+
+  done_width = (STANDARD_MENU_ITEM_BOX_WIDTH - (2 * STANDARD_MENU_BOX_X)) *
+      percent / 100;
+  label_changed = item->text == NULL || strcmp (item->text, label) != 0;
+  if (done_width == menu->gauge_width[index] && !label_changed)
+    return;
+
+  /* Only remember the new state, the bar gets painted with the next frame */
+  menu->gauge_width[index] = done_width;
+  //item->enabled = FALSE;
+  if (label_changed)
+    cairo_menu_set_item_text (menu->menu, index, label);
+  menu->gauge_changed[index] = TRUE;
+}
+
+void standard_menu_update_gauge (Menu *menu, unsigned int percent) {
+  char percent_text[6];
+
+  if (percent > 100)
+    percent = 100;
+
+  snprintf (percent_text, sizeof(percent_text), "%d%%", percent);
+  standard_menu_update_gauge_item (menu, 0, percent, percent_text);
 }
@@ -24,14 +24,24 @@
 #include <cairo/cairo.h>
 #include "cairo_menu.h"
 #include "cairo_utils.h"
+#include "arena.h"
+#include "bitset.h"
+#include "text_file.h"
 
 typedef struct Menu_s Menu;
 
 typedef struct {
+  arena_t arena;
+  char *buffer;
   int nlines;
   char **lines;
   int start_line;
+  /* For textboxes, nlines is how many lines of it fit on screen */
+  text_file_t *file;
   cairo_surface_t *surface;
+  int dirty;
+  /* Lines the text moved by since it was drawn, when not dirty */
+  int scroll;
 } MenuText;
 
 struct Menu_s {
@@ -39,12 +49,21 @@ struct Menu_s {
   CairoMenu *menu;
   int gauge;
   float gauge_rgb[6];
+  cairo_surface_t *gauge_full;
+  cairo_surface_t *gauge_empty;
+  /* Painted width of each bar, the width it should have at the next frame
+   * and the bars that need to be drawn again */
+  int *gauge_done;
+  int *gauge_width;
+  char *gauge_changed;
+  int gauge_slots;
   int width;
   int height;
   const char *title;
   MenuText text;
   int text_size;
   cairo_surface_t *frame;
+  int frame_content_height;
   void (*callback) (Menu *menu, int accepted);
   void (*draw) (Menu *menu, cairo_t *cr);
 };
@@ -60,6 +79,10 @@ typedef enum {
   MODE_YESNO,
   MODE_MSGBOX,
   MODE_GAUGE,
+  MODE_MIXEDGAUGE,
+  MODE_CHECKLIST,
+  MODE_RADIOLIST,
+  MODE_TEXTBOX,
 } whiptail_mode;
 
 typedef struct {
@@ -67,6 +90,7 @@ typedef struct {
   char *title;
   char *backtitle;
   char *text;
+  char *textbox;
   char *default_item;
   char *yes_button;
   char *no_button;
@@ -84,11 +108,25 @@ typedef struct {
   whiptail_mode mode;
   whiptail_menu_item *items;
   int num_items;
+  bitset_t checked;
+  int separate_output;
   // FBwhiptail arguments
   char *background_png;
   float background_grad_rgb[6];
   float gauge_rgb[6];
   int text_size;
+  int esc_delay;
+  int max_fps;
+  char *gauge_shm;
+  int gauge_pipe;
+  int gauge_pid;
+  int gauge_pid_fd;
+  char *gauge_file;
+  unsigned long long gauge_size;
+  int evdev;
+  char *menu_file;
+  int items_fd;
+  int stream_fd;
 } whiptail_args;
 
 
@@ -140,11 +178,20 @@ cairo_surface_t *create_gradient_background (int width, int height,
     float end_r, float end_g, float end_b);
 cairo_surface_t *load_image_and_scale (char *path, int width, int height);
 void draw_background (Menu *menu, cairo_t *cr);
-Menu *standard_menu_create (const char *title, char * text, int text_size,
+Menu *standard_menu_create (const char *title, const char *text, int text_size,
     int width, int height, int rows, int columns);
+void standard_menu_free (Menu *menu);
+int standard_menu_to_menu_coords (Menu *menu, int *x, int *y);
+void standard_menu_set_text (Menu *menu, const char *text);
+void standard_menu_set_text_file (Menu *menu, text_file_t *file);
+int standard_menu_scroll_text (Menu *menu, CairoMenuInput input);
 int standard_menu_add_item (Menu *menu, const char *title, int fontsize);
 int standard_menu_add_tag (Menu *menu, const char *title, int fontsize);
+int standard_menu_add_gauge (Menu *menu, const char *label, int fontsize);
+void standard_menu_update_gauge_item (Menu *menu, int index,
+    unsigned int percent, const char *label);
 void standard_menu_update_gauge (Menu *menu, unsigned int percent);
+cairo_surface_t *create_standard_checkbox (int size, int radio, int checked);
 cairo_surface_t * create_standard_gauge (int width, int height, unsigned int percent,
     float dr, float dg, float db, float r, float g, float b);
 
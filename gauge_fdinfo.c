@@ -0,0 +1,137 @@
+/*
+ * gauge_fdinfo.c : Follow the progress of another process's I/O
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "gauge_fdinfo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+struct _gauge_fdinfo {
+  /* The fdinfo file, or -1 when following a file's size */
+  int fd;
+  char path[PATH_MAX];
+};
+
+gauge_fdinfo_t *
+gauge_fdinfo_open_pid (int pid, int fd)
+{
+  gauge_fdinfo_t *info;
+  char fdinfo[PATH_MAX];
+
+  info = malloc (sizeof(gauge_fdinfo_t));
+  if (info == NULL)
+    return NULL;
+
+  /* Keep the fdinfo open, it can be read again from the start with pread()
+   * which saves us a path lookup on every sample */
+  snprintf (fdinfo, sizeof(fdinfo), "/proc/%d/fdinfo/%d", pid, fd);
+  snprintf (info->path, sizeof(info->path), "/proc/%d/fd/%d", pid, fd);
+  info->fd = open (fdinfo, O_RDONLY | O_CLOEXEC);
+  if (info->fd < 0) {
+    free (info);
+    return NULL;
+  }
+
+  return info;
+}
+
+gauge_fdinfo_t *
+gauge_fdinfo_open_file (const char *path)
+{
+  gauge_fdinfo_t *info;
+
+  if (strlen (path) >= PATH_MAX)
+    return NULL;
+
+  info = malloc (sizeof(gauge_fdinfo_t));
+  if (info == NULL)
+    return NULL;
+
+  info->fd = -1;
+  strcpy (info->path, path);
+
+  return info;
+}
+
+void
+gauge_fdinfo_close (gauge_fdinfo_t *info)
+{
+  if (info->fd >= 0)
+    close (info->fd);
+  free (info);
+}
+
+long long
+gauge_fdinfo_get_size (gauge_fdinfo_t *info)
+{
+  unsigned long long size = 0;
+  struct stat st;
+  int fd;
+
+  if (stat (info->path, &st) < 0)
+    return 0;
+  if (!S_ISBLK (st.st_mode))
+    return st.st_size;
+
+  /* Flashing tools usually write to a block device, which has no st_size */
+  fd = open (info->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+  if (ioctl (fd, BLKGETSIZE64, &size) < 0)
+    size = 0;
+  close (fd);
+
+  return size;
+}
+
+long long
+gauge_fdinfo_sample (gauge_fdinfo_t *info)
+{
+  char buffer[256];
+  char *pos;
+  struct stat st;
+  int len;
+
+  if (info->fd < 0) {
+    /* The file may not have been created yet */
+    if (stat (info->path, &st) < 0)
+      return 0;
+    return st.st_size;
+  }
+
+  /* Fails with ENOENT once the process exits or closes the fd */
+  len = pread (info->fd, buffer, sizeof(buffer) - 1, 0);
+  if (len <= 0)
+    return -1;
+  buffer[len] = 0;
+
+  pos = strstr (buffer, "pos:");
+  if (pos == NULL)
+    return -1;
+
+  return strtoll (pos + 4, NULL, 10);
+}
@@ -0,0 +1,47 @@
+/*
+ * gauge_fdinfo.h : Follow the progress of another process's I/O
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __GAUGE_FDINFO_H__
+#define __GAUGE_FDINFO_H__
+
+typedef struct _gauge_fdinfo gauge_fdinfo_t;
+
+/*
+ * Follow the file offset of @fd in process @pid, through
+ * /proc/<pid>/fdinfo/<fd>. Returns NULL on error.
+ */
+gauge_fdinfo_t *gauge_fdinfo_open_pid (int pid, int fd);
+/* Follow the size of the file at @path, as another process writes it */
+gauge_fdinfo_t *gauge_fdinfo_open_file (const char *path);
+void gauge_fdinfo_close (gauge_fdinfo_t *info);
+
+/*
+ * Size of the file or block device the process has open, or 0 if it can't
+ * be known.
+ */
+long long gauge_fdinfo_get_size (gauge_fdinfo_t *info);
+
+/*
+ * Get the current position. Returns -1 once the process closed the fd or
+ * exited.
+ */
+long long gauge_fdinfo_sample (gauge_fdinfo_t *info);
+
+#endif /* __GAUGE_FDINFO_H__ */
@@ -0,0 +1,159 @@
+/*
+ * gauge_parser.c : whiptail --gauge input protocol
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "gauge_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* With @strict, nothing but whitespace may follow the number */
+static int
+_parse_percent (const char *line, int strict, int *percent)
+{
+  char *endp;
+  long value;
+
+  value = strtol (line, &endp, 10);
+  if (endp == line)
+    return 0;
+  if (strict && endp[strspn (endp, " \t")] != 0)
+    return 0;
+
+  if (value < 0)
+    value = 0;
+  if (value > 100)
+    value = 100;
+  *percent = value;
+
+  return 1;
+}
+
+static int
+_append_block (gauge_parser_t *parser, const char *line, int len)
+{
+  /* Room for the line, its newline and the terminating NUL */
+  if (parser->block_len + len + 2 > parser->block_size) {
+    int size = parser->block_size ? parser->block_size : 256;
+    char *block;
+
+    while (parser->block_len + len + 2 > size)
+      size *= 2;
+    block = realloc (parser->block, size);
+    if (block == NULL)
+      return -1;
+    parser->block = block;
+    parser->block_size = size;
+  }
+
+  if (parser->block_len > 0)
+    parser->block[parser->block_len++] = '\n';
+  memcpy (parser->block + parser->block_len, line, len);
+  parser->block_len += len;
+  parser->block[parser->block_len] = 0;
+
+  return 0;
+}
+
+static int
+_handle_line (gauge_parser_t *parser, char *line, int len)
+{
+  char *text;
+
+  if (len > 0 && line[len - 1] == '\r')
+    line[--len] = 0;
+
+  switch (parser->state) {
+    case GAUGE_PARSER_PERCENT:
+      if (strcmp (line, "XXX") == 0) {
+        parser->state = GAUGE_PARSER_BLOCK_PERCENT;
+        return 0;
+      }
+      /* Item tags can start with a number too, like "1 -40" */
+      if (_parse_percent (line, parser->item_cb != NULL, &parser->percent))
+        return 1;
+      if (parser->item_cb) {
+        char *status = strpbrk (line, " \t");
+
+        if (status == NULL)
+          return 0;
+        *status++ = 0;
+        status += strspn (status, " \t");
+        parser->item_cb (line, status, parser->user_data);
+        return 1;
+      }
+      return 0;
+    case GAUGE_PARSER_BLOCK_PERCENT:
+      parser->state = GAUGE_PARSER_BLOCK_TEXT;
+      parser->block_len = 0;
+      if (parser->block)
+        parser->block[0] = 0;
+      return _parse_percent (line, 0, &parser->percent);
+    case GAUGE_PARSER_BLOCK_TEXT:
+      if (strcmp (line, "XXX") != 0) {
+        _append_block (parser, line, len);
+        return 0;
+      }
+      parser->state = GAUGE_PARSER_PERCENT;
+      text = strdup (parser->block ? parser->block : "");
+      if (text == NULL)
+        return 0;
+      free (parser->text);
+      parser->text = text;
+      parser->text_changed = 1;
+      return 1;
+  }
+
+  return 0;
+}
+
+void
+gauge_parser_init (gauge_parser_t *parser)
+{
+  memset (parser, 0, sizeof(gauge_parser_t));
+  parser->percent = -1;
+}
+
+void
+gauge_parser_clear (gauge_parser_t *parser)
+{
+  free (parser->text);
+  free (parser->block);
+  gauge_parser_init (parser);
+}
+
+int
+gauge_parser_feed (gauge_parser_t *parser, const char *data, int len)
+{
+  int changed = 0;
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (data[i] == '\n') {
+      parser->line[parser->line_len] = 0;
+      changed |= _handle_line (parser, parser->line, parser->line_len);
+      parser->line_len = 0;
+    } else if (parser->line_len < GAUGE_PARSER_MAX_LINE - 1) {
+      /* Overlong lines get truncated */
+      parser->line[parser->line_len++] = data[i];
+    }
+  }
+
+  return changed;
+}
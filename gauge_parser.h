@@ -0,0 +1,78 @@
+/*
+ * gauge_parser.h : whiptail --gauge input protocol
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __GAUGE_PARSER_H__
+#define __GAUGE_PARSER_H__
+
+#define GAUGE_PARSER_MAX_LINE 1024
+
+typedef enum {
+  GAUGE_PARSER_PERCENT = 0,
+  GAUGE_PARSER_BLOCK_PERCENT,
+  GAUGE_PARSER_BLOCK_TEXT,
+} gauge_parser_state;
+
+/**
+ * gauge_parser_item_cb:
+ * @tag: The first word of the line
+ * @status: The rest of the line
+ * @user_data: The @user_data of the #gauge_parser_t
+ *
+ * Called for "<tag> <status>" lines, used to update one of the bars of a
+ * mixed gauge.
+ */
+typedef void (*gauge_parser_item_cb) (const char *tag, const char *status,
+    void *user_data);
+
+/**
+ * gauge_parser_t:
+ * @percent: The latest percentage received, or -1 if none was received
+ * since it was last reset
+ * @text: The latest message received in a XXX block
+ * @text_changed: Set when @text was replaced
+ * @item_cb: If set, called for lines updating a single item
+ * @user_data: The user data for @item_cb
+ *
+ * Parses the input of whiptail --gauge: lines with a percentage, or
+ * "XXX", a percentage, the new message and a closing "XXX".
+ * Only the latest values are kept, the caller resets @percent and
+ * @text_changed once it has applied them.
+ */
+typedef struct {
+  int percent;
+  char *text;
+  int text_changed;
+  gauge_parser_item_cb item_cb;
+  void *user_data;
+  /* Private */
+  gauge_parser_state state;
+  char line[GAUGE_PARSER_MAX_LINE];
+  int line_len;
+  char *block;
+  int block_len;
+  int block_size;
+} gauge_parser_t;
+
+void gauge_parser_init (gauge_parser_t *parser);
+void gauge_parser_clear (gauge_parser_t *parser);
+/* Parse @len bytes of input. Returns 1 if @percent or @text changed */
+int gauge_parser_feed (gauge_parser_t *parser, const char *data, int len);
+
+#endif /* __GAUGE_PARSER_H__ */
@@ -0,0 +1,288 @@
+/*
+ * gauge_pipe.c : Forward a data stream while reporting its progress
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+#include "gauge_pipe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+/* Used when splice() isn't supported and for the default pipe size */
+#define GAUGE_PIPE_BUFFER_SIZE 65536
+
+struct _gauge_pipe {
+  event_loop_t *loop;
+  int in_fd;
+  int out_fd;
+  int out_flags;
+  /* Intermediate pipe between the input and the output */
+  int pipe_fds[2];
+  /* Userspace buffer, if we can't splice */
+  char *buffer;
+  int offset;
+  int capacity;
+  int buffered;
+  int reading;
+  int writing;
+  int eof;
+  uint64_t bytes;
+  gauge_pipe_progress_cb callback;
+  void *user_data;
+};
+
+static int _in_ready (event_loop_t *loop, int fd, short revents,
+    void *user_data);
+static int _out_ready (event_loop_t *loop, int fd, short revents,
+    void *user_data);
+
+/* How much more can be read before the output catches up */
+static int
+_room (gauge_pipe_t *pipe)
+{
+  /* The userspace buffer is only filled up to its end */
+  if (pipe->buffer)
+    return pipe->capacity - pipe->offset - pipe->buffered;
+  return pipe->capacity - pipe->buffered;
+}
+
+/* Switch to read()/write() for fds that can't be spliced */
+static int
+_fallback_to_copy (gauge_pipe_t *pipe)
+{
+  if (pipe->buffered > 0)
+    return -1;
+
+  pipe->buffer = malloc (GAUGE_PIPE_BUFFER_SIZE);
+  if (pipe->buffer == NULL)
+    return -1;
+  pipe->capacity = GAUGE_PIPE_BUFFER_SIZE;
+  pipe->offset = 0;
+
+  return 0;
+}
+
+static void
+_finish (gauge_pipe_t *pipe, int status)
+{
+  if (pipe->reading)
+    event_loop_remove_fd (pipe->loop, pipe->in_fd);
+  if (pipe->writing)
+    event_loop_remove_fd (pipe->loop, pipe->out_fd);
+  pipe->reading = pipe->writing = 0;
+  pipe->callback (pipe->bytes, status, pipe->user_data);
+}
+
+/* Write out as much as the output accepts. Returns -1 on error */
+static int
+_flush (gauge_pipe_t *pipe)
+{
+  ssize_t len;
+
+  while (pipe->buffered > 0) {
+    if (pipe->buffer)
+      len = write (pipe->out_fd, pipe->buffer + pipe->offset, pipe->buffered);
+    else
+      len = splice (pipe->pipe_fds[0], NULL, pipe->out_fd, NULL,
+          pipe->buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0 && errno == EAGAIN)
+      break;
+    if (len < 0 && errno == EINVAL && pipe->buffer == NULL) {
+      /* The output can't be spliced into, the data is still in the pipe so
+       * drain it into the buffer first */
+      char *buffer = malloc (GAUGE_PIPE_BUFFER_SIZE);
+      int done = 0;
+
+      if (buffer == NULL)
+        return -1;
+      while (done < pipe->buffered) {
+        len = read (pipe->pipe_fds[0], buffer + done, pipe->buffered - done);
+        if (len <= 0) {
+          free (buffer);
+          return -1;
+        }
+        done += len;
+      }
+      pipe->buffer = buffer;
+      pipe->capacity = GAUGE_PIPE_BUFFER_SIZE;
+      pipe->offset = 0;
+      continue;
+    }
+    if (len <= 0)
+      return -1;
+
+    pipe->buffered -= len;
+    pipe->offset += len;
+    pipe->bytes += len;
+  }
+  if (pipe->buffered == 0)
+    pipe->offset = 0;
+
+  /* Only wait for the output while it has something to write */
+  if (pipe->buffered > 0 && !pipe->writing) {
+    if (event_loop_add_fd (pipe->loop, pipe->out_fd, POLLOUT, _out_ready,
+            pipe) != 0)
+      return -1;
+    pipe->writing = 1;
+  } else if (pipe->buffered == 0 && pipe->writing) {
+    event_loop_remove_fd (pipe->loop, pipe->out_fd);
+    pipe->writing = 0;
+  }
+
+  /* And only read while there is room for more */
+  if (!pipe->eof && _room (pipe) > 0 && !pipe->reading) {
+    if (event_loop_add_fd (pipe->loop, pipe->in_fd, POLLIN, _in_ready,
+            pipe) != 0)
+      return -1;
+    pipe->reading = 1;
+  }
+
+  return 0;
+}
+
+static int
+_in_ready (event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  gauge_pipe_t *pipe = user_data;
+  ssize_t len;
+
+  while (_room (pipe) > 0) {
+    if (pipe->buffer) {
+      len = read (pipe->in_fd, pipe->buffer + pipe->offset + pipe->buffered,
+          _room (pipe));
+    } else {
+      len = splice (pipe->in_fd, NULL, pipe->pipe_fds[1], NULL,
+          _room (pipe), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (len < 0 && errno == EINVAL && _fallback_to_copy (pipe) == 0)
+        continue;
+    }
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0 && errno == EAGAIN)
+      break;
+    if (len < 0) {
+      _finish (pipe, -1);
+      return -1;
+    }
+    if (len == 0) {
+      pipe->eof = 1;
+      break;
+    }
+    pipe->buffered += len;
+  }
+
+  if (pipe->eof || _room (pipe) == 0) {
+    event_loop_remove_fd (loop, fd);
+    pipe->reading = 0;
+  }
+
+  if (_flush (pipe) != 0) {
+    _finish (pipe, -1);
+    return -1;
+  }
+
+  if (pipe->eof && pipe->buffered == 0)
+    _finish (pipe, 1);
+  else
+    pipe->callback (pipe->bytes, 0, pipe->user_data);
+
+  /* The fd was already removed if needed */
+  return 0;
+}
+
+static int
+_out_ready (event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  gauge_pipe_t *pipe = user_data;
+
+  if (_flush (pipe) != 0) {
+    _finish (pipe, -1);
+    return 0;
+  }
+
+  if (pipe->eof && pipe->buffered == 0)
+    _finish (pipe, 1);
+  else
+    pipe->callback (pipe->bytes, 0, pipe->user_data);
+
+  return 0;
+}
+
+gauge_pipe_t *
+gauge_pipe_new (event_loop_t *loop, int in_fd, int out_fd,
+    gauge_pipe_progress_cb callback, void *user_data)
+{
+  gauge_pipe_t *pipe;
+  int size;
+
+  pipe = malloc (sizeof(gauge_pipe_t));
+  if (pipe == NULL)
+    return NULL;
+
+  memset (pipe, 0, sizeof(gauge_pipe_t));
+  pipe->loop = loop;
+  pipe->in_fd = in_fd;
+  pipe->out_fd = out_fd;
+  pipe->callback = callback;
+  pipe->user_data = user_data;
+  pipe->pipe_fds[0] = pipe->pipe_fds[1] = -1;
+
+  if (pipe2 (pipe->pipe_fds, O_CLOEXEC | O_NONBLOCK) == 0) {
+    size = fcntl (pipe->pipe_fds[0], F_GETPIPE_SZ);
+    pipe->capacity = size > 0 ? size : GAUGE_PIPE_BUFFER_SIZE;
+  } else if (_fallback_to_copy (pipe) != 0) {
+    free (pipe);
+    return NULL;
+  }
+
+  /* Never block the UI on a slow consumer */
+  pipe->out_flags = fcntl (out_fd, F_GETFL);
+  fcntl (out_fd, F_SETFL, pipe->out_flags | O_NONBLOCK);
+
+  if (event_loop_add_fd (loop, in_fd, POLLIN, _in_ready, pipe) != 0) {
+    gauge_pipe_free (pipe);
+    return NULL;
+  }
+  pipe->reading = 1;
+
+  return pipe;
+}
+
+void
+gauge_pipe_free (gauge_pipe_t *pipe)
+{
+  if (pipe->reading)
+    event_loop_remove_fd (pipe->loop, pipe->in_fd);
+  if (pipe->writing)
+    event_loop_remove_fd (pipe->loop, pipe->out_fd);
+  if (pipe->out_flags != -1)
+    fcntl (pipe->out_fd, F_SETFL, pipe->out_flags);
+  if (pipe->pipe_fds[0] >= 0) {
+    close (pipe->pipe_fds[0]);
+    close (pipe->pipe_fds[1]);
+  }
+  free (pipe->buffer);
+  free (pipe);
+}
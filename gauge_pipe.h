@@ -0,0 +1,49 @@
+/*
+ * gauge_pipe.h : Forward a data stream while reporting its progress
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __GAUGE_PIPE_H__
+#define __GAUGE_PIPE_H__
+
+#include <stdint.h>
+#include "event_loop.h"
+
+typedef struct _gauge_pipe gauge_pipe_t;
+
+/**
+ * gauge_pipe_progress_cb:
+ * @bytes: The total number of bytes written to the output so far
+ * @status: 0 while data is flowing, 1 once the input reached its end and
+ * everything was written, -1 if reading or writing failed
+ * @user_data: The user data given to gauge_pipe_new()
+ */
+typedef void (*gauge_pipe_progress_cb) (uint64_t bytes, int status,
+    void *user_data);
+
+/*
+ * Copy everything from @in_fd to @out_fd from the event loop, without
+ * blocking on either of them. Data moves through a kernel pipe with splice()
+ * so it never gets copied to userspace, unless one of the fds doesn't
+ * support it. Returns NULL on error.
+ */
+gauge_pipe_t *gauge_pipe_new (event_loop_t *loop, int in_fd, int out_fd,
+    gauge_pipe_progress_cb callback, void *user_data);
+void gauge_pipe_free (gauge_pipe_t *pipe);
+
+#endif /* __GAUGE_PIPE_H__ */
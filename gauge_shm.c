@@ -0,0 +1,133 @@
+/*
+ * gauge_shm.c : Shared memory progress channel for the gauge
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "gauge_shm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Don't keep spinning on a producer that updates faster than we can copy */
+#define GAUGE_SHM_RETRIES 4
+
+struct _gauge_shm {
+  int fd;
+  const gauge_shm_record_t *record;
+  uint32_t last_sequence;
+  uint32_t text_serial;
+  char text[GAUGE_SHM_MAX_TEXT];
+};
+
+gauge_shm_t *
+gauge_shm_open (const char *path)
+{
+  gauge_shm_t *shm;
+  struct stat st;
+  void *map;
+
+  shm = malloc (sizeof(gauge_shm_t));
+  if (shm == NULL)
+    return NULL;
+  memset (shm, 0, sizeof(gauge_shm_t));
+
+  shm->fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (shm->fd < 0)
+    goto error;
+
+  /* A new file reads as all zeroes, which is a valid empty record */
+  if (fstat (shm->fd, &st) < 0)
+    goto error;
+  if (st.st_size < (off_t) sizeof(gauge_shm_record_t) &&
+      ftruncate (shm->fd, sizeof(gauge_shm_record_t)) < 0)
+    goto error;
+
+  map = mmap (NULL, sizeof(gauge_shm_record_t), PROT_READ, MAP_SHARED,
+      shm->fd, 0);
+  if (map == MAP_FAILED)
+    goto error;
+  shm->record = map;
+
+  return shm;
+ error:
+  if (shm->fd >= 0)
+    close (shm->fd);
+  free (shm);
+  return NULL;
+}
+
+void
+gauge_shm_close (gauge_shm_t *shm)
+{
+  munmap ((void *) shm->record, sizeof(gauge_shm_record_t));
+  close (shm->fd);
+  free (shm);
+}
+
+int
+gauge_shm_sample (gauge_shm_t *shm, int *percent, int *flags,
+    const char **text)
+{
+  const gauge_shm_record_t *record = shm->record;
+  uint32_t sequence;
+  uint32_t text_serial;
+  int32_t new_percent;
+  uint32_t new_flags;
+  int retries;
+
+  for (retries = 0; retries < GAUGE_SHM_RETRIES; retries++) {
+    sequence = __atomic_load_n (&record->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1)
+      continue;
+    if (sequence == shm->last_sequence)
+      return 0;
+
+    if (record->magic != GAUGE_SHM_MAGIC)
+      return 0;
+
+    new_percent = record->percent;
+    new_flags = record->flags;
+    text_serial = record->text_serial;
+    /* Only copy the message when the producer changed it, a serial of 0
+     * means it never set one */
+    if (text_serial != shm->text_serial)
+      memcpy (shm->text, record->text, GAUGE_SHM_MAX_TEXT);
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&record->sequence, __ATOMIC_RELAXED) != sequence)
+      continue;
+
+    shm->last_sequence = sequence;
+    *percent = new_percent;
+    *flags = new_flags;
+    *text = NULL;
+    if (text_serial != shm->text_serial) {
+      shm->text[GAUGE_SHM_MAX_TEXT - 1] = 0;
+      shm->text_serial = text_serial;
+      *text = shm->text;
+    }
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * gauge_shm.h : Shared memory progress channel for the gauge
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __GAUGE_SHM_H__
+#define __GAUGE_SHM_H__
+
+#include <stdint.h>
+
+#define GAUGE_SHM_MAGIC 0x31534746 /* "FGS1" */
+#define GAUGE_SHM_MAX_TEXT 1024
+
+/* Set in @flags by the producer to close the gauge */
+#define GAUGE_SHM_FLAG_DONE (1 << 0)
+
+/**
+ * gauge_shm_record_t:
+ * @magic: Always #GAUGE_SHM_MAGIC
+ * @sequence: Odd while the producer is writing the record
+ * @percent: The progress, from 0 to 100
+ * @flags: A combination of GAUGE_SHM_FLAG_*
+ * @text_serial: Incremented by the producer every time @text changes
+ * @text: The message to show above the gauge, NUL terminated
+ *
+ * The layout of the file given to --gauge-shm. The producer maps it shared
+ * and updates it like a seqlock: increment @sequence, write the fields,
+ * then increment @sequence again, with a release barrier after the first
+ * increment and before the second one. It never has to wait for us, a
+ * record that is being written is simply sampled again on the next tick.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t sequence;
+  int32_t percent;
+  uint32_t flags;
+  uint32_t text_serial;
+  char text[GAUGE_SHM_MAX_TEXT];
+} gauge_shm_record_t;
+
+typedef struct _gauge_shm gauge_shm_t;
+
+/*
+ * Map the record at @path, creating it if the producer didn't yet.
+ * Returns NULL on error.
+ */
+gauge_shm_t *gauge_shm_open (const char *path);
+void gauge_shm_close (gauge_shm_t *shm);
+
+/*
+ * Take a consistent snapshot of the record. Returns 1 if it changed since the
+ * last sample, in which case @percent and @flags are updated and @text is set
+ * to the new message or to NULL if the message didn't change. Returns 0 if
+ * nothing changed or if the producer was in the middle of an update.
+ */
+int gauge_shm_sample (gauge_shm_t *shm, int *percent, int *flags,
+    const char **text);
+
+#endif /* __GAUGE_SHM_H__ */
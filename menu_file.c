@@ -0,0 +1,183 @@
+/*
+ * menu_file.c : Load menu items from a file
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "menu_file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MENU_FILE_READ_SIZE (64 * 1024)
+
+/* Map a regular file. The mapping is private so it can be split in place */
+static int
+_map (menu_file_t *file, int fd)
+{
+  long page_size = sysconf (_SC_PAGESIZE);
+  struct stat st;
+  void *data;
+
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode) || st.st_size == 0)
+    return -1;
+
+  /* The last field needs a NUL after it. The rest of the last page is
+   * zero filled, but there is none if the file ends on a page boundary */
+  if (st.st_size % page_size == 0)
+    return -1;
+
+  data = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return -1;
+  madvise (data, st.st_size, MADV_SEQUENTIAL);
+
+  file->data = data;
+  file->size = st.st_size;
+  file->mapped = st.st_size;
+
+  return 0;
+}
+
+static int
+_read (menu_file_t *file, int fd)
+{
+  size_t allocated = 0;
+  char *data;
+  ssize_t len;
+
+  for (;;) {
+    if (allocated - file->size < MENU_FILE_READ_SIZE + 1) {
+      allocated = allocated ? allocated * 2 : 4 * MENU_FILE_READ_SIZE;
+      data = realloc (file->data, allocated);
+      if (data == NULL)
+        return -1;
+      file->data = data;
+    }
+
+    len = read (fd, file->data + file->size, allocated - file->size - 1);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0)
+      return -1;
+    if (len == 0)
+      break;
+    file->size += len;
+  }
+  file->data[file->size] = 0;
+
+  return 0;
+}
+
+static int
+_split (menu_file_t *file)
+{
+  char *ptr = file->data;
+  char *end = file->data + file->size;
+  int allocated = 0;
+  char delimiter;
+
+  delimiter = memchr (file->data, 0, file->size) ? '\0' : '\n';
+
+  while (ptr < end) {
+    char *next = memchr (ptr, delimiter, end - ptr);
+
+    if (next == NULL)
+      next = end;
+    *next = 0;
+    if (delimiter == '\n' && next > ptr && next[-1] == '\r')
+      next[-1] = 0;
+
+    if (file->nfields == allocated) {
+      char **fields;
+
+      allocated = allocated ? allocated * 2 : 256;
+      fields = realloc (file->fields, allocated * sizeof(char *));
+      if (fields == NULL)
+        return -1;
+      file->fields = fields;
+    }
+    file->fields[file->nfields++] = ptr;
+    ptr = next + 1;
+  }
+
+  /* A tag without its item */
+  if (file->nfields % 2) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+menu_file_t *
+menu_file_open_fd (int fd)
+{
+  menu_file_t *file;
+
+  file = malloc (sizeof(menu_file_t));
+  if (file == NULL)
+    return NULL;
+  memset (file, 0, sizeof(menu_file_t));
+
+  if (_map (file, fd) < 0 && _read (file, fd) < 0)
+    goto error;
+  if (_split (file) < 0)
+    goto error;
+
+  return file;
+ error:
+  menu_file_close (file);
+  return NULL;
+}
+
+menu_file_t *
+menu_file_open (const char *path)
+{
+  menu_file_t *file;
+  int fd;
+
+  if (strcmp (path, "-") == 0)
+    return menu_file_open_fd (STDIN_FILENO);
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  file = menu_file_open_fd (fd);
+  close (fd);
+
+  return file;
+}
+
+void
+menu_file_close (menu_file_t *file)
+{
+  int saved_errno = errno;
+
+  if (file->mapped)
+    munmap (file->data, file->mapped);
+  else
+    free (file->data);
+  free (file->fields);
+  free (file);
+  errno = saved_errno;
+}
@@ -0,0 +1,53 @@
+/*
+ * menu_file.h : Load menu items from a file
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __MENU_FILE_H__
+#define __MENU_FILE_H__
+
+#include <stddef.h>
+
+/**
+ * menu_file_t:
+ * @fields: The tag and item of each entry, one after the other. They point
+ * into @data and stay valid until menu_file_close()
+ * @nfields: The number of fields, always even
+ * @data: The contents of the file, split in place
+ * @size: The size of @data
+ *
+ * The fields are separated by NUL bytes if the file contains any, so that
+ * any text can be used, otherwise by newlines.
+ * Regular files are mapped instead of read, so only the pages holding a
+ * separator get copied.
+ */
+typedef struct {
+  char **fields;
+  int nfields;
+  char *data;
+  size_t size;
+  /* Private */
+  size_t mapped;
+} menu_file_t;
+
+/* Returns NULL on error, with errno set. @path "-" is stdin */
+menu_file_t *menu_file_open (const char *path);
+menu_file_t *menu_file_open_fd (int fd);
+void menu_file_close (menu_file_t *file);
+
+#endif /* __MENU_FILE_H__ */
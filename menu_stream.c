@@ -0,0 +1,207 @@
+/*
+ * menu_stream.c : Receive menu items while the menu is shown
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "menu_stream.h"
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define MENU_STREAM_READ_SIZE (64 * 1024)
+
+struct _menu_stream {
+  event_loop_t *loop;
+  int fd;
+  int done;
+  /* Owns the fields, so items never move once they are reported */
+  arena_t arena;
+  /* The start of a field that didn't fit in the last read */
+  char *partial;
+  size_t partial_len;
+  size_t partial_allocated;
+  /* The tag waiting for its item */
+  const char *tag;
+  /* -1 until the first separator is seen */
+  int delimiter;
+  menu_stream_item_cb callback;
+  void *user_data;
+};
+
+static int
+_append_partial (menu_stream_t *stream, const char *data, size_t len)
+{
+  if (stream->partial_len + len > stream->partial_allocated) {
+    size_t allocated = stream->partial_allocated ?
+        stream->partial_allocated : 256;
+    char *partial;
+
+    while (allocated < stream->partial_len + len)
+      allocated *= 2;
+    partial = realloc (stream->partial, allocated);
+    if (partial == NULL)
+      return -1;
+    stream->partial = partial;
+    stream->partial_allocated = allocated;
+  }
+  memcpy (stream->partial + stream->partial_len, data, len);
+  stream->partial_len += len;
+
+  return 0;
+}
+
+static int
+_add_field (menu_stream_t *stream, const char *data, size_t len)
+{
+  char *field;
+
+  if (stream->delimiter == '\n' && len > 0 && data[len - 1] == '\r')
+    len--;
+
+  field = arena_alloc (&stream->arena, len + 1);
+  if (field == NULL)
+    return -1;
+  memcpy (field, data, len);
+  field[len] = 0;
+
+  if (stream->tag == NULL) {
+    stream->tag = field;
+  } else {
+    stream->callback (stream->tag, field, stream->user_data);
+    stream->tag = NULL;
+  }
+
+  return 0;
+}
+
+/* Whichever of a newline or a NUL comes first decides the format */
+static void
+_find_delimiter (menu_stream_t *stream, const char *data, size_t len)
+{
+  const char *newline = memchr (data, '\n', len);
+  const char *nul = memchr (data, 0, newline ? (size_t) (newline - data) : len);
+
+  if (nul)
+    stream->delimiter = '\0';
+  else if (newline)
+    stream->delimiter = '\n';
+}
+
+static int
+_split (menu_stream_t *stream, const char *data, size_t len)
+{
+  const char *ptr = data;
+  const char *end = data + len;
+
+  if (stream->delimiter < 0)
+    _find_delimiter (stream, data, len);
+  if (stream->delimiter < 0)
+    return _append_partial (stream, data, len);
+
+  while (ptr < end) {
+    const char *next = memchr (ptr, stream->delimiter, end - ptr);
+
+    if (next == NULL)
+      return _append_partial (stream, ptr, end - ptr);
+
+    if (stream->partial_len > 0) {
+      if (_append_partial (stream, ptr, next - ptr) < 0 ||
+          _add_field (stream, stream->partial, stream->partial_len) < 0)
+        return -1;
+      stream->partial_len = 0;
+    } else if (_add_field (stream, ptr, next - ptr) < 0) {
+      return -1;
+    }
+    ptr = next + 1;
+  }
+
+  return 0;
+}
+
+static void
+_finish (menu_stream_t *stream)
+{
+  /* The last field doesn't need a separator after it */
+  if (stream->partial_len > 0)
+    _add_field (stream, stream->partial, stream->partial_len);
+  stream->partial_len = 0;
+  stream->done = 1;
+  stream->callback (NULL, NULL, stream->user_data);
+}
+
+/* Only one read per wakeup, so a fast writer can't starve the input */
+static int
+_stream_ready (event_loop_t *loop, int fd, short revents, void *user_data)
+{
+  menu_stream_t *stream = user_data;
+  char buffer[MENU_STREAM_READ_SIZE];
+  ssize_t len;
+
+  len = read (fd, buffer, sizeof(buffer));
+  if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    return 0;
+  if (len > 0 && _split (stream, buffer, len) == 0)
+    return 0;
+
+  _finish (stream);
+  return -1;
+}
+
+menu_stream_t *
+menu_stream_new (event_loop_t *loop, int fd, menu_stream_item_cb callback,
+    void *user_data)
+{
+  menu_stream_t *stream;
+  int flags;
+
+  stream = malloc (sizeof(menu_stream_t));
+  if (stream == NULL)
+    return NULL;
+
+  memset (stream, 0, sizeof(menu_stream_t));
+  stream->loop = loop;
+  stream->fd = fd;
+  stream->delimiter = -1;
+  stream->callback = callback;
+  stream->user_data = user_data;
+  arena_init (&stream->arena, 0);
+
+  flags = fcntl (fd, F_GETFL);
+  if (flags < 0 || fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+      event_loop_add_fd (loop, fd, POLLIN, _stream_ready, stream) != 0) {
+    free (stream);
+    return NULL;
+  }
+
+  return stream;
+}
+
+void
+menu_stream_free (menu_stream_t *stream)
+{
+  if (!stream->done)
+    event_loop_remove_fd (stream->loop, stream->fd);
+  arena_clear (&stream->arena);
+  free (stream->partial);
+  free (stream);
+}
@@ -0,0 +1,48 @@
+/*
+ * menu_stream.h : Receive menu items while the menu is shown
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __MENU_STREAM_H__
+#define __MENU_STREAM_H__
+
+#include "event_loop.h"
+
+typedef struct _menu_stream menu_stream_t;
+
+/**
+ * menu_stream_item_cb:
+ * @tag: The tag of the new item, or #NULL once the stream has ended
+ * @item: The text of the new item, or #NULL once the stream has ended
+ * @user_data: The user data given to menu_stream_new()
+ *
+ * The strings stay valid until menu_stream_free().
+ */
+typedef void (*menu_stream_item_cb) (const char *tag, const char *item,
+    void *user_data);
+
+/*
+ * Read tag/item pairs from @fd as they arrive, from the event loop. The
+ * fields are separated by newlines, or by NUL bytes if the first separator
+ * in the stream is a NUL. Returns NULL on error.
+ */
+menu_stream_t *menu_stream_new (event_loop_t *loop, int fd,
+    menu_stream_item_cb callback, void *user_data);
+void menu_stream_free (menu_stream_t *stream);
+
+#endif /* __MENU_STREAM_H__ */
@@ -0,0 +1,144 @@
+/*
+ * tag_index.c : Hash table from menu tags to item indices
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "tag_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *tag;
+  unsigned int hash;
+  int value;
+} tag_index_entry_t;
+
+/* Open addressing with linear probing, kept at most half full */
+struct _tag_index {
+  tag_index_entry_t *entries;
+  unsigned int mask;
+  int nentries;
+};
+
+static unsigned int
+_hash (const char *tag)
+{
+  /* FNV-1a */
+  unsigned int hash = 2166136261u;
+
+  while (*tag)
+    hash = (hash ^ (unsigned char) *tag++) * 16777619u;
+
+  return hash;
+}
+
+static tag_index_entry_t *
+_find (tag_index_t *index, const char *tag, unsigned int hash)
+{
+  unsigned int i;
+
+  for (i = hash & index->mask;; i = (i + 1) & index->mask) {
+    tag_index_entry_t *entry = &index->entries[i];
+
+    if (entry->tag == NULL ||
+        (entry->hash == hash && strcmp (entry->tag, tag) == 0))
+      return entry;
+  }
+}
+
+static int
+_grow (tag_index_t *index)
+{
+  tag_index_entry_t *old = index->entries;
+  unsigned int old_size = old ? index->mask + 1 : 0;
+  unsigned int size = old_size ? old_size * 2 : 16;
+  unsigned int i;
+
+  index->entries = calloc (size, sizeof(tag_index_entry_t));
+  if (index->entries == NULL) {
+    index->entries = old;
+    return -1;
+  }
+  index->mask = size - 1;
+
+  for (i = 0; i < old_size; i++) {
+    if (old[i].tag)
+      *_find (index, old[i].tag, old[i].hash) = old[i];
+  }
+  free (old);
+
+  return 0;
+}
+
+tag_index_t *
+tag_index_new (int ntags)
+{
+  tag_index_t *index;
+
+  index = malloc (sizeof(tag_index_t));
+  if (index == NULL)
+    return NULL;
+  memset (index, 0, sizeof(tag_index_t));
+
+  /* Size it up front so building it doesn't need to rehash */
+  do {
+    if (_grow (index) != 0) {
+      tag_index_free (index);
+      return NULL;
+    }
+  } while ((int) (index->mask + 1) / 2 < ntags);
+
+  return index;
+}
+
+void
+tag_index_free (tag_index_t *index)
+{
+  free (index->entries);
+  free (index);
+}
+
+int
+tag_index_add (tag_index_t *index, const char *tag, int value)
+{
+  unsigned int hash = _hash (tag);
+  tag_index_entry_t *entry;
+
+  if ((index->nentries + 1) * 2 > (int) (index->mask + 1) &&
+      _grow (index) != 0)
+    return -1;
+
+  entry = _find (index, tag, hash);
+  if (entry->tag == NULL) {
+    entry->tag = tag;
+    entry->hash = hash;
+    entry->value = value;
+    index->nentries++;
+  }
+
+  return 0;
+}
+
+int
+tag_index_lookup (tag_index_t *index, const char *tag)
+{
+  tag_index_entry_t *entry = _find (index, tag, _hash (tag));
+
+  return entry->tag ? entry->value : -1;
+}
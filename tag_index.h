@@ -0,0 +1,37 @@
+/*
+ * tag_index.h : Hash table from menu tags to item indices
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __TAG_INDEX_H__
+#define __TAG_INDEX_H__
+
+typedef struct _tag_index tag_index_t;
+
+/*
+ * Create an index for about @ntags tags. The tags are not copied, they need
+ * to stay valid for as long as the index is used.
+ */
+tag_index_t *tag_index_new (int ntags);
+void tag_index_free (tag_index_t *index);
+/* Returns -1 on error. If @tag was already added, the first one is kept */
+int tag_index_add (tag_index_t *index, const char *tag, int value);
+/* Returns the value of @tag, or -1 if it's not in the index */
+int tag_index_lookup (tag_index_t *index, const char *tag);
+
+#endif /* __TAG_INDEX_H__ */
@@ -0,0 +1,252 @@
+/*
+ * text_file.c : Lines of a text file, indexed as they are needed
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "text_file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TEXT_FILE_READ_SIZE (64 * 1024)
+/* One line start out of this many is remembered */
+#define TEXT_FILE_CHECKPOINT_LINES 1024
+/* How much of the file is searched for newlines at a time */
+#define TEXT_FILE_INDEX_CHUNK (1024 * 1024)
+
+/*
+ * Only the start of every TEXT_FILE_CHECKPOINT_LINES line is kept, so the
+ * index stays tiny even for huge files, and a line is found by searching
+ * forward from the closest checkpoint, or from the last line that was
+ * looked up since the lines on screen are read in order.
+ */
+struct _text_file {
+  char *data;
+  size_t size;
+  size_t mapped;
+  size_t *checkpoints;
+  int ncheckpoints;
+  int allocated_checkpoints;
+  /* How far newlines were searched, and how many line starts were found */
+  size_t indexed;
+  int nlines;
+  int complete;
+  int last_line;
+  size_t last_offset;
+};
+
+static int
+_map (text_file_t *file, int fd)
+{
+  struct stat st;
+  void *data;
+
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode) || st.st_size == 0)
+    return -1;
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return -1;
+  madvise (data, st.st_size, MADV_SEQUENTIAL);
+
+  file->data = data;
+  file->size = st.st_size;
+  file->mapped = st.st_size;
+
+  return 0;
+}
+
+static int
+_read (text_file_t *file, int fd)
+{
+  size_t allocated = 0;
+  char *data;
+  ssize_t len;
+
+  for (;;) {
+    if (allocated - file->size < TEXT_FILE_READ_SIZE) {
+      allocated = allocated ? allocated * 2 : 4 * TEXT_FILE_READ_SIZE;
+      data = realloc (file->data, allocated);
+      if (data == NULL)
+        return -1;
+      file->data = data;
+    }
+
+    len = read (fd, file->data + file->size, allocated - file->size);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0)
+      return -1;
+    if (len == 0)
+      break;
+    file->size += len;
+  }
+
+  return 0;
+}
+
+static int
+_add_checkpoint (text_file_t *file, size_t offset)
+{
+  if (file->ncheckpoints == file->allocated_checkpoints) {
+    int allocated = file->allocated_checkpoints ?
+        file->allocated_checkpoints * 2 : 64;
+    size_t *checkpoints;
+
+    checkpoints = realloc (file->checkpoints, allocated * sizeof(size_t));
+    if (checkpoints == NULL)
+      return -1;
+    file->checkpoints = checkpoints;
+    file->allocated_checkpoints = allocated;
+  }
+  file->checkpoints[file->ncheckpoints++] = offset;
+
+  return 0;
+}
+
+/* Search the next chunk of the file for line starts */
+static int
+_index_chunk (text_file_t *file)
+{
+  const char *ptr = file->data + file->indexed;
+  const char *end = file->data + file->size;
+  const char *newline;
+
+  if (end - ptr > TEXT_FILE_INDEX_CHUNK)
+    end = ptr + TEXT_FILE_INDEX_CHUNK;
+
+  while ((newline = memchr (ptr, '\n', end - ptr)) != NULL) {
+    ptr = newline + 1;
+    /* A newline at the very end doesn't start another line */
+    if (ptr == file->data + file->size)
+      break;
+    if (file->nlines % TEXT_FILE_CHECKPOINT_LINES == 0 &&
+        _add_checkpoint (file, ptr - file->data) < 0)
+      return -1;
+    file->nlines++;
+  }
+  file->indexed = end - file->data;
+  if (file->indexed == file->size)
+    file->complete = 1;
+
+  return 0;
+}
+
+text_file_t *
+text_file_open (const char *path)
+{
+  text_file_t *file;
+  int fd;
+
+  file = malloc (sizeof(text_file_t));
+  if (file == NULL)
+    return NULL;
+  memset (file, 0, sizeof(text_file_t));
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    goto error;
+  if (_map (file, fd) < 0 && _read (file, fd) < 0) {
+    close (fd);
+    goto error;
+  }
+  close (fd);
+
+  /* The first line starts at the start of the file, if it isn't empty */
+  if (file->size > 0) {
+    if (_add_checkpoint (file, 0) < 0)
+      goto error;
+    file->nlines = 1;
+  } else {
+    file->complete = 1;
+  }
+
+  return file;
+ error:
+  text_file_close (file);
+  return NULL;
+}
+
+void
+text_file_close (text_file_t *file)
+{
+  int saved_errno = errno;
+
+  if (file->mapped)
+    munmap (file->data, file->mapped);
+  else
+    free (file->data);
+  free (file->checkpoints);
+  free (file);
+  errno = saved_errno;
+}
+
+int
+text_file_get_line (text_file_t *file, int line, const char **text,
+    size_t *len)
+{
+  const char *ptr, *end, *newline;
+  int current;
+
+  if (line < 0)
+    return -1;
+  while (line >= file->nlines && !file->complete) {
+    if (_index_chunk (file) < 0)
+      return -1;
+  }
+  if (line >= file->nlines)
+    return -1;
+
+  /* Start from the checkpoint, or from the last line if it's closer */
+  current = (line / TEXT_FILE_CHECKPOINT_LINES) * TEXT_FILE_CHECKPOINT_LINES;
+  ptr = file->data + file->checkpoints[line / TEXT_FILE_CHECKPOINT_LINES];
+  if (file->last_line <= line && file->last_line > current) {
+    current = file->last_line;
+    ptr = file->data + file->last_offset;
+  }
+
+  end = file->data + file->size;
+  for (; current < line; current++)
+    ptr = (const char *) memchr (ptr, '\n', end - ptr) + 1;
+  file->last_line = line;
+  file->last_offset = ptr - file->data;
+
+  newline = memchr (ptr, '\n', end - ptr);
+  *text = ptr;
+  *len = (newline ? newline : end) - ptr;
+  if (*len > 0 && ptr[*len - 1] == '\r')
+    (*len)--;
+
+  return 0;
+}
+
+int
+text_file_count_lines (text_file_t *file)
+{
+  while (!file->complete) {
+    if (_index_chunk (file) < 0)
+      return -1;
+  }
+
+  return file->nlines;
+}
@@ -0,0 +1,44 @@
+/*
+ * text_file.h : Lines of a text file, indexed as they are needed
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __TEXT_FILE_H__
+#define __TEXT_FILE_H__
+
+#include <stddef.h>
+
+typedef struct _text_file text_file_t;
+
+/*
+ * Map @path without reading it. Files that can't be mapped, like pipes, are
+ * read into memory instead. Returns NULL on error, with errno set.
+ */
+text_file_t *text_file_open (const char *path);
+void text_file_close (text_file_t *file);
+/*
+ * Find line @line, which is not NUL terminated and doesn't include its
+ * newline. The file is only indexed up to that line.
+ * Returns -1 if the file has fewer lines.
+ */
+int text_file_get_line (text_file_t *file, int line, const char **text,
+    size_t *len);
+/* Index the whole file to count its lines */
+int text_file_count_lines (text_file_t *file);
+
+#endif /* __TEXT_FILE_H__ */
@@ -0,0 +1,195 @@
+/*
+ * type_ahead.c : Jump to menu items by typing their first letters
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "type_ahead.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+typedef struct {
+  const char *key;
+  int index;
+} type_ahead_entry_t;
+
+/*
+ * The keys are sorted case insensitively, so the items matching a prefix
+ * are a contiguous range. Each new character only narrows the range of the
+ * previous prefix.
+ */
+struct _type_ahead {
+  int nkeys;
+  type_ahead_key_cb key_cb;
+  void *user_data;
+  type_ahead_entry_t *sorted;
+  char prefix[TYPE_AHEAD_MAX_PREFIX];
+  int len;
+  int start;
+  int end;
+};
+
+static int
+_compare (const void *a, const void *b)
+{
+  const type_ahead_entry_t *ea = a;
+  const type_ahead_entry_t *eb = b;
+  int ret = strcasecmp (ea->key, eb->key);
+
+  return ret ? ret : ea->index - eb->index;
+}
+
+/* Sorting is only done once something actually gets typed */
+static int
+_build (type_ahead_t *ta)
+{
+  int i;
+
+  ta->sorted = malloc (ta->nkeys * sizeof(type_ahead_entry_t));
+  if (ta->sorted == NULL)
+    return -1;
+
+  for (i = 0; i < ta->nkeys; i++) {
+    ta->sorted[i].key = ta->key_cb (i, ta->user_data);
+    ta->sorted[i].index = i;
+  }
+  qsort (ta->sorted, ta->nkeys, sizeof(type_ahead_entry_t), _compare);
+
+  return 0;
+}
+
+/* First entry in [start, end) whose character at @pos is >= @c */
+static int
+_lower_bound (type_ahead_t *ta, int start, int end, int pos, int c)
+{
+  while (start < end) {
+    int mid = start + (end - start) / 2;
+
+    if (tolower ((unsigned char) ta->sorted[mid].key[pos]) < c)
+      start = mid + 1;
+    else
+      end = mid;
+  }
+
+  return start;
+}
+
+/* The lowest index after @after in the range, wrapping around */
+static int
+_next_match (type_ahead_t *ta, int after)
+{
+  int best = -1, first = -1;
+  int i;
+
+  for (i = ta->start; i < ta->end; i++) {
+    int index = ta->sorted[i].index;
+
+    if (first == -1 || index < first)
+      first = index;
+    if (index > after && (best == -1 || index < best))
+      best = index;
+  }
+
+  return best != -1 ? best : first;
+}
+
+type_ahead_t *
+type_ahead_new (int nkeys, type_ahead_key_cb key_cb, void *user_data)
+{
+  type_ahead_t *ta;
+
+  ta = malloc (sizeof(type_ahead_t));
+  if (ta == NULL)
+    return NULL;
+
+  memset (ta, 0, sizeof(type_ahead_t));
+  ta->nkeys = nkeys;
+  ta->key_cb = key_cb;
+  ta->user_data = user_data;
+  type_ahead_reset (ta);
+
+  return ta;
+}
+
+void
+type_ahead_free (type_ahead_t *ta)
+{
+  free (ta->sorted);
+  free (ta);
+}
+
+void
+type_ahead_set_count (type_ahead_t *ta, int nkeys)
+{
+  /* Sorted again on the next key, which also finds the range of the
+   * prefix typed so far among the new keys */
+  free (ta->sorted);
+  ta->sorted = NULL;
+  ta->nkeys = nkeys;
+}
+
+void
+type_ahead_reset (type_ahead_t *ta)
+{
+  ta->len = 0;
+  ta->start = 0;
+  ta->end = ta->nkeys;
+}
+
+int
+type_ahead_feed (type_ahead_t *ta, char c, int current)
+{
+  int lc = tolower ((unsigned char) c);
+  int start, end, i;
+
+  if (ta->sorted == NULL) {
+    if (_build (ta) != 0)
+      return -1;
+    ta->start = 0;
+    ta->end = ta->nkeys;
+    for (i = 0; i < ta->len; i++) {
+      int pc = tolower ((unsigned char) ta->prefix[i]);
+
+      ta->start = _lower_bound (ta, ta->start, ta->end, i, pc);
+      ta->end = _lower_bound (ta, ta->start, ta->end, i, pc + 1);
+    }
+  }
+
+  /* Same letter again, go to the next item starting with it */
+  if (ta->len == 1 && tolower ((unsigned char) ta->prefix[0]) == lc)
+    return _next_match (ta, current);
+
+  if (ta->len == TYPE_AHEAD_MAX_PREFIX)
+    return -1;
+
+  start = _lower_bound (ta, ta->start, ta->end, ta->len, lc);
+  end = _lower_bound (ta, start, ta->end, ta->len, lc + 1);
+  /* Keep the previous prefix so the next character can still match */
+  if (start == end)
+    return -1;
+
+  ta->prefix[ta->len++] = c;
+  ta->start = start;
+  ta->end = end;
+
+  /* A new first letter moves past the current item, after that the current
+   * item is fine as long as it still matches */
+  return _next_match (ta, ta->len == 1 ? current : current - 1);
+}
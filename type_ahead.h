@@ -0,0 +1,45 @@
+/*
+ * type_ahead.h : Jump to menu items by typing their first letters
+ *
+ * Copyright (C) Youness Alaoui (KaKaRoTo)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef __TYPE_AHEAD_H__
+#define __TYPE_AHEAD_H__
+
+#define TYPE_AHEAD_MAX_PREFIX 64
+
+typedef const char *(*type_ahead_key_cb) (int index, void *user_data);
+
+typedef struct _type_ahead type_ahead_t;
+
+/* @key_cb returns the text to match for each of the @nkeys items */
+type_ahead_t *type_ahead_new (int nkeys, type_ahead_key_cb key_cb,
+    void *user_data);
+void type_ahead_free (type_ahead_t *ta);
+/* The number of items changed, the typed prefix is kept */
+void type_ahead_set_count (type_ahead_t *ta, int nkeys);
+/* Forget the typed prefix */
+void type_ahead_reset (type_ahead_t *ta);
+/*
+ * Add @c to the typed prefix and return the item to select, starting from
+ * @current, or -1 if nothing matches. Typing the same first letter again
+ * cycles through the items starting with it.
+ */
+int type_ahead_feed (type_ahead_t *ta, char c, int current);
+
+#endif /* __TYPE_AHEAD_H__ */